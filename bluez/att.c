@@ -718,6 +718,81 @@ ssize_t dec_read_resp(const uint8_t *pdu, size_t len, uint8_t *value,
     return len - 1;
 }
 
+/* Read Multiple Request, or Read Multiple Variable Length Request if variable
+ * is set. At least two handles are required. */
+uint16_t enc_read_multi_req(const uint16_t *handles, int num,
+                            gboolean variable, uint8_t *pdu, size_t len)
+{
+    const uint16_t min_len = sizeof(pdu[0]) + num * sizeof(handles[0]);
+
+    if (pdu == NULL || handles == NULL)
+        return 0;
+
+    if (num < 2)
+        return 0;
+
+    if (len < min_len)
+        return 0;
+
+    pdu[0] = variable ? ATT_OP_READ_MULTI_VL_REQ : ATT_OP_READ_MULTI_REQ;
+    for (int i = 0; i < num; i++)
+        att_put_u16(handles[i], &pdu[1 + i * sizeof(handles[0])]);
+
+    return min_len;
+}
+
+/* Returns the Set Of Values, or the Length Value Tuple List for the variable
+ * length response, without the opcode. */
+ssize_t dec_read_multi_resp(const uint8_t *pdu, size_t len, uint8_t *value,
+                            size_t vlen)
+{
+    if (pdu == NULL || len < 1)
+        return -EINVAL;
+
+    if (pdu[0] != ATT_OP_READ_MULTI_RESP &&
+        pdu[0] != ATT_OP_READ_MULTI_VL_RESP)
+        return -EINVAL;
+
+    if (value == NULL)
+        return len - 1;
+
+    if (vlen < (len - 1))
+        return -ENOBUFS;
+
+    memcpy(value, pdu + 1, len - 1);
+
+    return len - 1;
+}
+
+/* Returns the handle and value of the Handle Length Value Tuple at offset of
+ * a Multiple Handle Value Notification, the first one is at offset 1, and
+ * the offset of the following one: len after the last one. */
+ssize_t dec_notify_multi(const uint8_t *pdu, size_t len, size_t offset,
+                         uint16_t *handle, const uint8_t **value,
+                         uint16_t *vlen)
+{
+    uint16_t size;
+
+    if (pdu == NULL || len < 1)
+        return -EINVAL;
+
+    if (pdu[0] != ATT_OP_HANDLE_NOTIFY_MULTI)
+        return -EINVAL;
+
+    if (offset < 1 || offset + 4 > len)
+        return -EINVAL;
+
+    size = att_get_u16(&pdu[offset + 2]);
+    if (offset + 4 + size > len)
+        return -EINVAL;
+
+    *handle = att_get_u16(&pdu[offset]);
+    *value = &pdu[offset + 4];
+    *vlen = size;
+
+    return offset + 4 + size;
+}
+
 uint16_t enc_error_resp(uint8_t opcode, uint16_t handle, uint8_t status,
                         uint8_t *pdu, size_t len)
 {
@@ -152,6 +152,9 @@ static inline bt_uuid_t att_get_uuid128(const void *ptr)
 #define ATT_OP_EXEC_WRITE_RESP              0x19
 #define ATT_OP_HANDLE_CNF                   0x1E
 #define ATT_OP_SIGNED_WRITE_CMD             0xD2
+#define ATT_OP_READ_MULTI_VL_REQ            0x20
+#define ATT_OP_READ_MULTI_VL_RESP           0x21
+#define ATT_OP_HANDLE_NOTIFY_MULTI          0x23
 
 /* Error codes for Error response PDU */
 #define ATT_ECODE_INVALID_HANDLE            0x01
@@ -251,6 +254,13 @@ uint16_t enc_read_blob_resp(uint8_t *value, size_t vlen, uint16_t offset,
                             uint8_t *pdu, size_t len);
 ssize_t dec_read_resp(const uint8_t *pdu, size_t len, uint8_t *value,
                       size_t vlen);
+uint16_t enc_read_multi_req(const uint16_t *handles, int num,
+                            gboolean variable, uint8_t *pdu, size_t len);
+ssize_t dec_read_multi_resp(const uint8_t *pdu, size_t len, uint8_t *value,
+                            size_t vlen);
+ssize_t dec_notify_multi(const uint8_t *pdu, size_t len, size_t offset,
+                         uint16_t *handle, const uint8_t **value,
+                         uint16_t *vlen);
 uint16_t enc_error_resp(uint8_t opcode, uint16_t handle, uint8_t status,
                         uint8_t *pdu, size_t len);
 uint16_t enc_find_info_req(uint16_t start, uint16_t end, uint8_t *pdu,
@@ -79,6 +79,7 @@ struct set_opts {
     int flushable;
     uint32_t priority;
     uint16_t voice;
+    GMainContext *context;
 };
 
 struct connect {
@@ -268,9 +269,26 @@ static gboolean server_cb(GIOChannel *io, GIOCondition cond,
     return TRUE;
 }
 
+/* Watches are attached to context, NULL for the global default context */
+static guint io_add_watch(GIOChannel *io, GMainContext *context,
+                          GIOCondition cond, GIOFunc func, gpointer user_data,
+                          GDestroyNotify destroy)
+{
+    GSource *source;
+    guint id;
+
+    source = g_io_create_watch(io, cond);
+    g_source_set_priority(source, G_PRIORITY_DEFAULT);
+    g_source_set_callback(source, (GSourceFunc) func, user_data, destroy);
+    id = g_source_attach(source, context);
+    g_source_unref(source);
+
+    return id;
+}
+
 static void server_add(GIOChannel *io, BtIOConnect connect,
                        BtIOConfirm confirm, gpointer user_data,
-                       GDestroyNotify destroy)
+                       GDestroyNotify destroy, GMainContext *context)
 {
     struct server *server;
     GIOCondition cond;
@@ -282,12 +300,13 @@ static void server_add(GIOChannel *io, BtIOConnect connect,
     server->destroy = destroy;
 
     cond = G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL;
-    g_io_add_watch_full(io, G_PRIORITY_DEFAULT, cond, server_cb, server,
-                        (GDestroyNotify) server_remove);
+    io_add_watch(io, context, cond, server_cb, server,
+                 (GDestroyNotify) server_remove);
 }
 
 static void connect_add(GIOChannel *io, BtIOConnect connect,
-                        gpointer user_data, GDestroyNotify destroy)
+                        gpointer user_data, GDestroyNotify destroy,
+                        GMainContext *context)
 {
     struct connect *conn;
     GIOCondition cond;
@@ -297,8 +316,8 @@ static void connect_add(GIOChannel *io, BtIOConnect connect,
     conn->user_data = user_data;
     conn->destroy = destroy;
     cond = G_IO_OUT | G_IO_ERR | G_IO_HUP | G_IO_NVAL;
-    g_io_add_watch_full(io, G_PRIORITY_DEFAULT, cond, connect_cb, conn,
-                        (GDestroyNotify) connect_remove);
+    io_add_watch(io, context, cond, connect_cb, conn,
+                 (GDestroyNotify) connect_remove);
 }
 
 static void accept_add(GIOChannel *io, BtIOConnect connect,
@@ -313,8 +332,8 @@ static void accept_add(GIOChannel *io, BtIOConnect connect,
     accept->destroy = destroy;
 
     cond = G_IO_OUT | G_IO_ERR | G_IO_HUP | G_IO_NVAL;
-    g_io_add_watch_full(io, G_PRIORITY_DEFAULT, cond, accept_cb, accept,
-                        (GDestroyNotify) accept_remove);
+    io_add_watch(io, NULL, cond, accept_cb, accept,
+                 (GDestroyNotify) accept_remove);
 }
 
 static int l2cap_bind(int sock, const bdaddr_t *src, uint8_t src_type,
@@ -839,6 +858,9 @@ static gboolean parse_set_opts(struct set_opts *opts, GError **err,
             case BT_IO_OPT_VOICE:
                 opts->voice = va_arg(args, int);
                 break;
+            case BT_IO_OPT_CONTEXT:
+                opts->context = va_arg(args, GMainContext *);
+                break;
             default:
                 g_set_error(err, BT_IO_ERROR, EINVAL,
                             "Unknown option %d", opt);
@@ -1452,7 +1474,7 @@ GIOChannel *bt_io_connect(BtIOConnect connect, gpointer user_data,
         return NULL;
     }
 
-    connect_add(io, connect, user_data, destroy);
+    connect_add(io, connect, user_data, destroy, opts.context);
 
     return io;
 }
@@ -1490,7 +1512,7 @@ GIOChannel *bt_io_listen(BtIOConnect connect, BtIOConfirm confirm,
         return NULL;
     }
 
-    server_add(io, connect, confirm, user_data, destroy);
+    server_add(io, connect, confirm, user_data, destroy, opts.context);
 
     return io;
 }
@@ -39,6 +39,7 @@
 
 struct discover_primary {
     GAttrib *attrib;
+    guint id; /* Of every page, so that one cancel stops the discovery */
     bt_uuid_t uuid;
     GSList *primaries;
     gatt_cb_t cb;
@@ -48,6 +49,7 @@ struct discover_primary {
 /* Used for the Included Services Discovery (ISD) procedure */
 struct included_discovery {
     GAttrib    *attrib;
+    guint    id; /* Of every page */
     int    refs;
     int    err;
     uint16_t  end_handle;
@@ -63,6 +65,7 @@ struct included_uuid_query {
 
 struct discover_char {
     GAttrib *attrib;
+    guint id; /* Of every page */
     bt_uuid_t *uuid;
     uint16_t end;
     GSList *characteristics;
@@ -180,7 +183,8 @@ static void primary_by_uuid_cb(guint8 status, const guint8 *ipdu,
     if (oplen == 0)
         goto done;
 
-    g_attrib_send(dp->attrib, 0, buf, oplen, primary_by_uuid_cb, dp, NULL);
+    g_attrib_send(dp->attrib, dp->id, buf, oplen, primary_by_uuid_cb, dp,
+                  NULL);
     return;
 
 done:
@@ -246,7 +250,7 @@ static void primary_all_cb(guint8 status, const guint8 *ipdu, guint16 iplen,
         guint16 oplen = encode_discover_primary(end + 1, 0xffff, NULL,
                                                 buf, buflen);
 
-        g_attrib_send(dp->attrib, 0, buf, oplen, primary_all_cb,
+        g_attrib_send(dp->attrib, dp->id, buf, oplen, primary_all_cb,
                       dp, NULL);
 
         return;
@@ -284,7 +288,11 @@ guint gatt_discover_primary(GAttrib *attrib, bt_uuid_t *uuid, gatt_cb_t func,
     } else
         cb = primary_all_cb;
 
-    return g_attrib_send(attrib, 0, buf, plen, cb, dp, NULL);
+    dp->id = g_attrib_send(attrib, 0, buf, plen, cb, dp, NULL);
+    if (dp->id == 0)
+        discover_primary_free(dp);
+
+    return dp->id;
 }
 
 static void resolve_included_uuid_cb(uint8_t status, const uint8_t *pdu,
@@ -367,13 +375,18 @@ static guint find_included(struct included_discovery *isd, uint16_t start)
     size_t buflen;
     uint8_t *buf = g_attrib_get_buffer(isd->attrib, &buflen);
     guint16 oplen;
+    guint id;
 
     bt_uuid16_create(&uuid, GATT_INCLUDE_UUID);
     oplen = enc_read_by_type_req(start, isd->end_handle, &uuid,
                                  buf, buflen);
 
-    return g_attrib_send(isd->attrib, 0, buf, oplen, find_included_cb,
-                         isd_ref(isd), (GDestroyNotify) isd_unref);
+    id = g_attrib_send(isd->attrib, isd->id, buf, oplen, find_included_cb,
+                       isd_ref(isd), (GDestroyNotify) isd_unref);
+    if (isd->id == 0)
+        isd->id = id;
+
+    return id;
 }
 
 static void find_included_cb(uint8_t status, const uint8_t *pdu, uint16_t len,
@@ -509,7 +522,7 @@ static void char_discovered_cb(guint8 status, const guint8 *ipdu,
         if (oplen == 0)
             return;
 
-        g_attrib_send(dc->attrib, 0, buf, oplen, char_discovered_cb,
+        g_attrib_send(dc->attrib, dc->id, buf, oplen, char_discovered_cb,
                       dc, NULL);
 
         return;
@@ -548,8 +561,12 @@ guint gatt_discover_char(GAttrib *attrib, uint16_t start, uint16_t end,
     dc->end = end;
     dc->uuid = g_memdup(uuid, sizeof(bt_uuid_t));
 
-    return g_attrib_send(attrib, 0, buf, plen, char_discovered_cb,
-                         dc, NULL);
+    dc->id = g_attrib_send(attrib, 0, buf, plen, char_discovered_cb,
+                           dc, NULL);
+    if (dc->id == 0)
+        discover_char_free(dc);
+
+    return dc->id;
 }
 
 guint gatt_read_char_by_uuid(GAttrib *attrib, uint16_t start, uint16_t end,
@@ -567,12 +584,28 @@ guint gatt_read_char_by_uuid(GAttrib *attrib, uint16_t start, uint16_t end,
     return g_attrib_send(attrib, 0, buf, plen, func, user_data, NULL);
 }
 
+guint gatt_read_multi(GAttrib *attrib, const uint16_t *handles, int num,
+                      gboolean variable, GAttribResultFunc func,
+                      gpointer user_data)
+{
+    size_t buflen;
+    uint8_t *buf = g_attrib_get_buffer(attrib, &buflen);
+    guint16 plen;
+
+    plen = enc_read_multi_req(handles, num, variable, buf, buflen);
+    if (plen == 0)
+        return 0;
+
+    return g_attrib_send(attrib, 0, buf, plen, func, user_data, NULL);
+}
+
 struct read_long_data {
     GAttrib *attrib;
     GAttribResultFunc func;
     gpointer user_data;
     guint8 *buffer;
     guint16 size;
+    guint alloc;
     guint16 handle;
     guint id;
     int ref;
@@ -606,15 +639,21 @@ static void read_blob_helper(guint8 status, const guint8 *rpdu, guint16 rlen,
         goto done;
     }
 
-    tmp = g_try_realloc(long_read->buffer, long_read->size + rlen - 1);
+    if (long_read->size + rlen - 1 > long_read->alloc) {
+        /* Longer than allowed by the specification, grow geometrically so
+         * that the value is not copied on every response */
+        guint alloc = MAX(long_read->alloc * 2, long_read->size + rlen - 1);
 
-    if (tmp == NULL) {
-        status = ATT_ECODE_INSUFF_RESOURCES;
-        goto done;
+        tmp = g_try_realloc(long_read->buffer, alloc);
+        if (tmp == NULL) {
+            status = ATT_ECODE_INSUFF_RESOURCES;
+            goto done;
+        }
+        long_read->buffer = tmp;
+        long_read->alloc = alloc;
     }
 
-    memcpy(&tmp[long_read->size], &rpdu[1], rlen - 1);
-    long_read->buffer = tmp;
+    memcpy(&long_read->buffer[long_read->size], &rpdu[1], rlen - 1);
     long_read->size += rlen - 1;
 
     buf = g_attrib_get_buffer(long_read->attrib, &buflen);
@@ -650,7 +689,9 @@ static void read_char_helper(guint8 status, const guint8 *rpdu,
     if (status != 0 || rlen < buflen)
         goto done;
 
-    long_read->buffer = g_malloc(rlen);
+    /* Room for the longest value allowed, plus the opcode */
+    long_read->alloc = MAX(rlen, ATT_MAX_VALUE_LEN + 1);
+    long_read->buffer = g_try_malloc(long_read->alloc);
     if (long_read->buffer == NULL) {
         status = ATT_ECODE_INSUFF_RESOURCES;
         goto done;
@@ -693,10 +734,15 @@ guint gatt_read_char(GAttrib *attrib, uint16_t handle, GAttribResultFunc func,
     long_read->user_data = user_data;
     long_read->handle = handle;
 
-    buf = g_attrib_get_buffer(attrib, &buflen);
+    buf = g_attrib_reserve(attrib, &buflen);
+    if (buf == NULL) {
+        g_free(long_read);
+        return 0;
+    }
+
     plen = enc_read_req(handle, buf, buflen);
-    id = g_attrib_send(attrib, 0, buf, plen, read_char_helper,
-                       long_read, read_long_destroy);
+    id = g_attrib_commit(attrib, 0, plen, read_char_helper, long_read,
+                         read_long_destroy);
     if (id == 0)
         g_free(long_read);
     else {
@@ -707,6 +753,25 @@ guint gatt_read_char(GAttrib *attrib, uint16_t handle, GAttribResultFunc func,
     return id;
 }
 
+guint gatt_read_blob(GAttrib *attrib, uint16_t handle, uint16_t offset,
+                     GAttribResultFunc func, gpointer user_data)
+{
+    uint8_t *buf;
+    size_t buflen;
+    guint16 plen;
+
+    buf = g_attrib_reserve(attrib, &buflen);
+    if (buf == NULL)
+        return 0;
+
+    if (offset == 0)
+        plen = enc_read_req(handle, buf, buflen);
+    else
+        plen = enc_read_blob_req(handle, offset, buf, buflen);
+
+    return g_attrib_commit(attrib, 0, plen, func, user_data, NULL);
+}
+
 struct write_long_data {
     GAttrib *attrib;
     GAttribResultFunc func;
@@ -792,12 +857,15 @@ guint gatt_write_char(GAttrib *attrib, uint16_t handle, uint8_t *value,
     if (vlen <= buflen - 3) {
         uint16_t plen;
 
+        buf = g_attrib_reserve(attrib, &buflen);
+        if (buf == NULL)
+            return 0;
+
         plen = enc_write_req(handle, value, vlen, buf, buflen);
         if (plen == 0)
             return 0;
 
-        return g_attrib_send(attrib, 0, buf, plen, func, user_data,
-                             NULL);
+        return g_attrib_commit(attrib, 0, plen, func, user_data, NULL);
     }
 
     /* Write Long Characteristic Values */
@@ -849,9 +917,29 @@ guint gatt_write_cmd(GAttrib *attrib, uint16_t handle, uint8_t *value,
     size_t buflen;
     guint16 plen;
 
-    buf = g_attrib_get_buffer(attrib, &buflen);
+    buf = g_attrib_reserve(attrib, &buflen);
+    if (buf == NULL)
+        return 0;
+
     plen = enc_write_cmd(handle, value, vlen, buf, buflen);
-    return g_attrib_send(attrib, 0, buf, plen, NULL, user_data, notify);
+    return g_attrib_commit(attrib, 0, plen, NULL, user_data, notify);
+}
+
+guint gatt_write_cmd_data(GAttrib *attrib, uint16_t handle,
+                          const uint8_t *value, int vlen,
+                          GDestroyNotify notify, gpointer user_data)
+{
+    uint8_t hdr[3];
+    size_t buflen;
+    guint16 plen;
+
+    g_attrib_get_buffer(attrib, &buflen);
+    if (vlen > (int) buflen - (int) sizeof(hdr))
+        return 0;
+
+    plen = enc_write_cmd(handle, NULL, 0, hdr, sizeof(hdr));
+    return g_attrib_send_data(attrib, 0, hdr, plen, value, vlen, NULL,
+                              user_data, notify);
 }
 
 static sdp_data_t *proto_seq_find(sdp_list_t *proto_list)
@@ -88,6 +88,11 @@ guint gatt_discover_char(GAttrib *attrib, uint16_t start, uint16_t end,
 guint gatt_read_char(GAttrib *attrib, uint16_t handle, GAttribResultFunc func,
                      gpointer user_data);
 
+/* Read the part of a value from offset on, with a single Read Request at
+ * offset 0 or Read Blob Request else: the response is not continued */
+guint gatt_read_blob(GAttrib *attrib, uint16_t handle, uint16_t offset,
+                     GAttribResultFunc func, gpointer user_data);
+
 guint gatt_write_char(GAttrib *attrib, uint16_t handle, uint8_t *value,
                       size_t vlen, GAttribResultFunc func,
                       gpointer user_data);
@@ -98,10 +103,19 @@ guint gatt_discover_char_desc(GAttrib *attrib, uint16_t start, uint16_t end,
 guint gatt_write_cmd(GAttrib *attrib, uint16_t handle, uint8_t *value,
                      int vlen, GDestroyNotify notify, gpointer user_data);
 
+/* Same without copying value, which must stay valid until notify is called */
+guint gatt_write_cmd_data(GAttrib *attrib, uint16_t handle,
+                          const uint8_t *value, int vlen,
+                          GDestroyNotify notify, gpointer user_data);
+
 guint gatt_read_char_by_uuid(GAttrib *attrib, uint16_t start, uint16_t end,
                              bt_uuid_t *uuid, GAttribResultFunc func,
                              gpointer user_data);
 
+guint gatt_read_multi(GAttrib *attrib, const uint16_t *handles, int num,
+                      gboolean variable, GAttribResultFunc func,
+                      gpointer user_data);
+
 guint gatt_exchange_mtu(GAttrib *attrib, uint16_t mtu, GAttribResultFunc func,
                         gpointer user_data);
 
@@ -27,9 +27,16 @@
 #include "config.h"
 #endif
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* sendmmsg */
+#endif
+
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
 #include <glib.h>
 
 #include <stdio.h>
@@ -44,6 +51,16 @@
 
 #define GATT_TIMEOUT 30
 
+/* PDUs given to each sendmmsg call, and sent at most per G_IO_OUT wakeup */
+#define SEND_BATCH 32
+#define SEND_MAX_PER_WAKEUP 256
+
+/* Commands kept for reuse by each GAttrib */
+#define MAX_FREE_CMDS 64
+
+/* Released receive buffers kept for reuse by each GAttrib */
+#define MAX_FREE_RX_BUFS 16
+
 //#define DEBUG_ON
 #ifdef DEBUG_ON
 #define DBG(...) printf("[GATTRIB] " __VA_ARGS__)
@@ -53,19 +70,33 @@
 
 struct _GAttrib {
     GIOChannel *io;
+    GMainContext *context;
     int refs;
     uint8_t *buf;
     size_t buflen;
+    struct rx_buffer *rx; /* Sized from buflen before each read */
+    GBytes *rx_bytes; /* Wraps rx once handed out, see g_attrib_ref_pdu() */
+    struct rx_pool *rx_pool;
     guint read_watch;
     guint write_watch;
     guint timeout_watch;
     GQueue *requests;
     GQueue *responses;
     GSList *events;
+    /* Index of events for the dispatch of each PDU. Not locked either:
+     * events are only (un)registered from the GAttrib context. */
+    GHashTable *handle_events; /* Handle -> GSList of its events */
+    GSList *wildcard_events; /* Events on any handle or opcode */
+    GHashTable *uuid_events; /* UUID string -> GSList of its events */
     guint next_cmd_id;
     GDestroyNotify destroy;
     gpointer destroy_user_data;
     bool stale;
+    /* Slab of recycled commands, not locked: the commands are only sent
+     * and released from the thread running the GAttrib context. */
+    struct command *free_cmds;
+    guint nb_free_cmds;
+    struct command *reserved; /* See g_attrib_reserve() */
 };
 
 struct command {
@@ -73,11 +104,31 @@ struct command {
     guint8 opcode;
     guint8 *pdu;
     guint16 len;
+    const guint8 *data; /* Sent after pdu, not owned */
+    guint16 data_len;
     guint8 expected;
     bool sent;
     GAttribResultFunc func;
     gpointer user_data;
     GDestroyNotify notify;
+    struct _GAttrib *attrib;
+    struct command *next_free;
+    size_t size; /* Room in slot */
+    guint8 slot[]; /* Holds pdu */
+};
+
+/* Receive buffers handed out by g_attrib_ref_pdu() come back to their pool
+ * when released, from any thread. It outlives the GAttrib until the last
+ * one is back */
+struct rx_pool {
+    gint refs;
+    GAsyncQueue *free; /* Released buffers, of any size */
+};
+
+struct rx_buffer {
+    struct rx_pool *pool;
+    size_t size;
+    guint8 data[];
 };
 
 struct event {
@@ -88,8 +139,33 @@ struct event {
     GAttribNotifyFunc func;
     gpointer user_data;
     GDestroyNotify notify;
+    bool auto_confirm; /* See g_attrib_set_auto_confirm() */
 };
 
+/* Every source of the GAttrib lives on its context, g_source_remove() only
+ * works on the default one. */
+static guint attrib_add_source(struct _GAttrib *attrib, GSource *source,
+                               GSourceFunc func, gpointer user_data,
+                               GDestroyNotify notify)
+{
+    guint id;
+
+    g_source_set_priority(source, G_PRIORITY_DEFAULT);
+    g_source_set_callback(source, func, user_data, notify);
+    id = g_source_attach(source, attrib->context);
+    g_source_unref(source);
+
+    return id;
+}
+
+static void attrib_remove_source(struct _GAttrib *attrib, guint id)
+{
+    GSource *source = g_main_context_find_source_by_id(attrib->context, id);
+
+    if (source)
+        g_source_destroy(source);
+}
+
 static guint8 opcode2expected(guint8 opcode)
 {
     switch (opcode) {
@@ -114,6 +190,9 @@ static guint8 opcode2expected(guint8 opcode)
         case ATT_OP_READ_MULTI_REQ:
             return ATT_OP_READ_MULTI_RESP;
 
+        case ATT_OP_READ_MULTI_VL_REQ:
+            return ATT_OP_READ_MULTI_VL_RESP;
+
         case ATT_OP_READ_BY_GROUP_REQ:
             return ATT_OP_READ_BY_GROUP_RESP;
 
@@ -144,6 +223,7 @@ static bool is_response(guint8 opcode)
         case ATT_OP_READ_RESP:
         case ATT_OP_READ_BLOB_RESP:
         case ATT_OP_READ_MULTI_RESP:
+        case ATT_OP_READ_MULTI_VL_RESP:
         case ATT_OP_READ_BY_GROUP_RESP:
         case ATT_OP_WRITE_RESP:
         case ATT_OP_PREP_WRITE_RESP:
@@ -170,13 +250,197 @@ GAttrib *g_attrib_ref(GAttrib *attrib)
     return attrib;
 }
 
+/* Get a command with room for a PDU of len bytes, and at least the MTU so
+ * that it can be reused for any other one. Recycled ones come first. */
+static struct command *command_new(struct _GAttrib *attrib, size_t len)
+{
+    struct command *c = attrib->free_cmds;
+    size_t size;
+
+    if (c && c->size >= len) {
+        attrib->free_cmds = c->next_free;
+        attrib->nb_free_cmds--;
+        size = c->size;
+    } else {
+        size = MAX(len, attrib->buflen);
+        c = g_try_malloc(sizeof(*c) + size);
+        if (c == NULL)
+            return NULL;
+    }
+
+    memset(c, 0, sizeof(*c));
+    c->attrib = attrib;
+    c->size = size;
+    c->pdu = c->slot;
+
+    return c;
+}
+
 static void command_destroy(struct command *cmd)
 {
+    struct _GAttrib *attrib = cmd->attrib;
+
     if (cmd->notify)
         cmd->notify(cmd->user_data);
 
-    g_free(cmd->pdu);
-    g_free(cmd);
+    if (attrib->nb_free_cmds < MAX_FREE_CMDS &&
+        cmd->size >= attrib->buflen) {
+        cmd->next_free = attrib->free_cmds;
+        attrib->free_cmds = cmd;
+        attrib->nb_free_cmds++;
+    } else
+        g_free(cmd);
+}
+
+/* Release the recycled commands, e.g. once they are too small for the MTU */
+static void free_commands(struct _GAttrib *attrib)
+{
+    struct command *c;
+
+    while ((c = attrib->free_cmds)) {
+        attrib->free_cmds = c->next_free;
+        g_free(c);
+    }
+    attrib->nb_free_cmds = 0;
+}
+
+static struct rx_pool *rx_pool_new(void)
+{
+    struct rx_pool *pool = g_new0(struct rx_pool, 1);
+
+    pool->refs = 1;
+    pool->free = g_async_queue_new_full(g_free);
+    return pool;
+}
+
+static void rx_pool_unref(struct rx_pool *pool)
+{
+    if (g_atomic_int_dec_and_test(&pool->refs)) {
+        g_async_queue_unref(pool->free);
+        g_free(pool);
+    }
+}
+
+/* Free function of the GBytes wrapping a receive buffer */
+static void rx_buffer_release(gpointer data)
+{
+    struct rx_buffer *rx = data;
+    struct rx_pool *pool = rx->pool;
+
+    if (g_async_queue_length(pool->free) < MAX_FREE_RX_BUFS)
+        g_async_queue_push(pool->free, rx);
+    else
+        g_free(rx);
+    rx_pool_unref(pool);
+}
+
+/* The peer sends PDUs of at most the MTU, which may have been raised since
+ * the last one. It is never resized while a PDU is handled */
+static struct rx_buffer *rx_buffer_get(struct _GAttrib *attrib)
+{
+    struct rx_buffer *rx = attrib->rx;
+
+    if (rx && rx->size == attrib->buflen)
+        return rx;
+    g_free(rx);
+
+    while ((rx = g_async_queue_try_pop(attrib->rx_pool->free)) &&
+           rx->size != attrib->buflen)
+        g_free(rx);
+
+    if (rx == NULL) {
+        rx = g_malloc(sizeof(*rx) + attrib->buflen);
+        rx->pool = attrib->rx_pool;
+        rx->size = attrib->buflen;
+    }
+
+    attrib->rx = rx;
+    return rx;
+}
+
+/* Once the PDU is handled, a buffer still referenced belongs to its GBytes,
+ * the next PDU is read in another one */
+static void rx_buffer_done(struct _GAttrib *attrib)
+{
+    if (attrib->rx_bytes == NULL)
+        return;
+
+    g_bytes_unref(attrib->rx_bytes);
+    attrib->rx_bytes = NULL;
+    attrib->rx = NULL;
+}
+
+/* The lists of the index tables are keyed by the handle or the UUID of
+ * their first event */
+static gpointer event_key(struct event *evt, bool by_uuid)
+{
+    return by_uuid ? (gpointer) evt->uuid_str : GUINT_TO_POINTER(evt->handle);
+}
+
+static void index_add(GHashTable *table, struct event *evt, bool by_uuid)
+{
+    GSList *list = g_hash_table_lookup(table, event_key(evt, by_uuid));
+
+    list = g_slist_append(list, evt);
+    if (list->next == NULL)
+        g_hash_table_insert(table, event_key(evt, by_uuid), list);
+}
+
+static void index_remove(GHashTable *table, struct event *evt, bool by_uuid)
+{
+    GSList *list = g_hash_table_lookup(table, event_key(evt, by_uuid));
+
+    /* The key may belong to evt */
+    g_hash_table_steal(table, event_key(evt, by_uuid));
+    list = g_slist_remove(list, evt);
+    if (list)
+        g_hash_table_insert(table, event_key(list->data, by_uuid), list);
+}
+
+static bool is_wildcard_event(struct event *evt)
+{
+    return evt->expected == GATTRIB_ALL_EVENTS ||
+           evt->expected == GATTRIB_ALL_REQS ||
+           evt->handle == GATTRIB_ALL_HANDLES;
+}
+
+static void event_index(struct _GAttrib *attrib, struct event *evt)
+{
+    if (is_wildcard_event(evt))
+        attrib->wildcard_events = g_slist_append(attrib->wildcard_events,
+                                                 evt);
+    else
+        index_add(attrib->handle_events, evt, false);
+    index_add(attrib->uuid_events, evt, true);
+}
+
+static void event_unindex(struct _GAttrib *attrib, struct event *evt)
+{
+    if (is_wildcard_event(evt))
+        attrib->wildcard_events = g_slist_remove(attrib->wildcard_events,
+                                                 evt);
+    else
+        index_remove(attrib->handle_events, evt, false);
+    index_remove(attrib->uuid_events, evt, true);
+}
+
+static void free_index_table(GHashTable *table)
+{
+    GHashTableIter iter;
+    gpointer list;
+
+    g_hash_table_iter_init(&iter, table);
+    while (g_hash_table_iter_next(&iter, NULL, &list))
+        g_slist_free(list);
+    g_hash_table_remove_all(table);
+}
+
+static void event_index_clear(struct _GAttrib *attrib)
+{
+    free_index_table(attrib->handle_events);
+    free_index_table(attrib->uuid_events);
+    g_slist_free(attrib->wildcard_events);
+    attrib->wildcard_events = NULL;
 }
 
 static void event_destroy(struct event *evt)
@@ -204,6 +468,10 @@ static void attrib_destroy(GAttrib *attrib)
     g_queue_free(attrib->responses);
     attrib->responses = NULL;
 
+    event_index_clear(attrib);
+    g_hash_table_destroy(attrib->handle_events);
+    g_hash_table_destroy(attrib->uuid_events);
+
     for (l = attrib->events; l; l = l->next)
         event_destroy(l->data);
 
@@ -211,18 +479,26 @@ static void attrib_destroy(GAttrib *attrib)
     attrib->events = NULL;
 
     if (attrib->timeout_watch > 0)
-        g_source_remove(attrib->timeout_watch);
+        attrib_remove_source(attrib, attrib->timeout_watch);
 
     if (attrib->write_watch > 0)
-        g_source_remove(attrib->write_watch);
+        attrib_remove_source(attrib, attrib->write_watch);
 
     if (attrib->read_watch > 0)
-        g_source_remove(attrib->read_watch);
+        attrib_remove_source(attrib, attrib->read_watch);
 
     if (attrib->io)
         g_io_channel_unref(attrib->io);
 
+    if (attrib->context)
+        g_main_context_unref(attrib->context);
+
+    free_commands(attrib);
+    g_free(attrib->reserved);
     g_free(attrib->buf);
+    rx_buffer_done(attrib);
+    g_free(attrib->rx);
+    rx_pool_unref(attrib->rx_pool);
 
     if (attrib->destroy)
         attrib->destroy(attrib->destroy_user_data);
@@ -298,15 +574,44 @@ done:
     return FALSE;
 }
 
+/* Gather the commands that can be sent at once: the responses, then the
+ * commands of attrib->requests up to the first one expecting a response,
+ * included unless it was already sent. */
+static int get_send_batch(struct _GAttrib *attrib, struct command **batch,
+                          int max)
+{
+    GList *l;
+    int n = 0;
+
+    for (l = g_queue_peek_head_link(attrib->responses); l && n < max;
+         l = l->next)
+        batch[n++] = l->data;
+
+    for (l = g_queue_peek_head_link(attrib->requests); l && n < max;
+         l = l->next) {
+        struct command *cmd = l->data;
+
+        if (cmd->sent)
+            break;
+
+        batch[n++] = cmd;
+        if (cmd->expected != 0)
+            break;
+    }
+
+    return n;
+}
+
 static gboolean can_write_data(GIOChannel *io, GIOCondition cond,
                                gpointer data)
 {
     struct _GAttrib *attrib = data;
-    struct command *cmd;
-    GError *gerr = NULL;
-    gsize len;
-    GIOStatus iostat;
-    GQueue *queue;
+    struct command *batch[SEND_BATCH];
+    struct mmsghdr msgs[SEND_BATCH];
+    struct iovec iov[SEND_BATCH][2];
+    int fd = g_io_channel_unix_get_fd(io);
+    int total = 0;
+    int i, n, sent;
 
     if (attrib->stale)
         return FALSE;
@@ -314,48 +619,66 @@ static gboolean can_write_data(GIOChannel *io, GIOCondition cond,
     if (cond & (G_IO_HUP | G_IO_ERR | G_IO_NVAL))
         return FALSE;
 
-    queue = attrib->responses;
-    cmd = g_queue_peek_head(queue);
-    if (cmd == NULL) {
-        queue = attrib->requests;
-        cmd = g_queue_peek_head(queue);
-    }
-    if (cmd == NULL)
-        return FALSE;
+    /* Send everything eligible, several PDUs per system call, until the
+     * socket is full. Stop after a while to let the other sources run. */
+    while (total < SEND_MAX_PER_WAKEUP) {
+        GSList *done = NULL;
 
-    /*
-     * Verify that we didn't already send this command. This can only
-     * happen with elementes from attrib->requests.
-     */
-    if (cmd->sent)
-        return FALSE;
+        n = get_send_batch(attrib, batch, SEND_BATCH);
+        if (n == 0)
+            return FALSE;
 
-    iostat = g_io_channel_write_chars(io, (char *) cmd->pdu, cmd->len,
-                                      &len, &gerr);
-    if (iostat != G_IO_STATUS_NORMAL) {
-        if (gerr) {
-            printf("%s", gerr->message);
-            g_error_free(gerr);
+        memset(msgs, 0, n * sizeof(msgs[0]));
+        for (i = 0; i < n; i++) {
+            /* One packet per command, the channel is not buffered */
+            iov[i][0].iov_base = batch[i]->pdu;
+            iov[i][0].iov_len = batch[i]->len;
+            iov[i][1].iov_base = (void *) batch[i]->data;
+            iov[i][1].iov_len = batch[i]->data_len;
+            msgs[i].msg_hdr.msg_iov = iov[i];
+            msgs[i].msg_hdr.msg_iovlen = batch[i]->data_len ? 2 : 1;
         }
 
-        return FALSE;
-    }
-
-    if (cmd->expected == 0) {
-        g_queue_pop_head(queue);
-        command_destroy(cmd);
+        sent = sendmmsg(fd, msgs, n, MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EINTR)
+                return TRUE;
+            perror("sendmmsg");
+            return FALSE;
+        }
+        total += sent;
+
+        /* Take the sent commands out before any notify function can change
+         * the queues */
+        for (i = 0; i < sent; i++) {
+            struct command *cmd = batch[i];
+
+            if (cmd->expected != 0) {
+                cmd->sent = true;
+                if (attrib->timeout_watch == 0)
+                    attrib->timeout_watch = attrib_add_source(attrib,
+                                    g_timeout_source_new_seconds(GATT_TIMEOUT),
+                                    disconnect_timeout, attrib, NULL);
+                continue;
+            }
+
+            if (!g_queue_remove(attrib->responses, cmd))
+                g_queue_remove(attrib->requests, cmd);
+            done = g_slist_prepend(done, cmd);
+        }
 
-        return TRUE;
-    }
+        done = g_slist_reverse(done);
+        g_slist_free_full(done, (GDestroyNotify) command_destroy);
 
-    cmd->sent = true;
+        if (attrib->stale)
+            return FALSE;
 
-    if (attrib->timeout_watch == 0)
-        attrib->timeout_watch = g_timeout_add_seconds(GATT_TIMEOUT,
-                                                      disconnect_timeout,
-                                                      attrib);
+        /* The socket is full */
+        if (sent < n)
+            return TRUE;
+    }
 
-    return FALSE;
+    return TRUE;
 }
 
 static void destroy_sender(gpointer data)
@@ -372,10 +695,10 @@ static void wake_up_sender(struct _GAttrib *attrib)
         return;
 
     attrib = g_attrib_ref(attrib);
-    attrib->write_watch = g_io_add_watch_full(attrib->io,
-                                              G_PRIORITY_DEFAULT, G_IO_OUT,
-                                              can_write_data, attrib,
-                                              destroy_sender);
+    attrib->write_watch = attrib_add_source(attrib,
+                                    g_io_create_watch(attrib->io, G_IO_OUT),
+                                    (GSourceFunc) can_write_data, attrib,
+                                    destroy_sender);
 }
 
 static bool match_event(struct event *evt, const uint8_t *pdu, gsize len)
@@ -402,15 +725,134 @@ static bool match_event(struct event *evt, const uint8_t *pdu, gsize len)
     return false;
 }
 
+static guint command_queue(struct _GAttrib *attrib, guint id,
+                           struct command *c, GAttribResultFunc func,
+                           gpointer user_data, GDestroyNotify notify)
+{
+    GQueue *queue;
+    uint8_t opcode;
+
+    opcode = c->pdu[0];
+
+    c->opcode = opcode;
+    c->expected = opcode2expected(opcode);
+    c->func = func;
+    c->user_data = user_data;
+    c->notify = notify;
+
+    if (is_response(opcode))
+        queue = attrib->responses;
+    else
+        queue = attrib->requests;
+
+    if (id) {
+        c->id = id;
+        if (!is_response(opcode))
+            g_queue_push_head(queue, c);
+        else
+            /* Don't re-order responses even if an ID is given */
+            g_queue_push_tail(queue, c);
+    } else {
+        c->id = ++attrib->next_cmd_id;
+        g_queue_push_tail(queue, c);
+    }
+
+    /*
+     * If a command was added to the queue and it was empty before, wake up
+     * the sender. If the sender was already woken up by the second queue,
+     * wake_up_sender will just return.
+     */
+    if (g_queue_get_length(queue) == 1)
+        wake_up_sender(attrib);
+
+    return c->id;
+}
+
+/* Answer an indication before it is dispatched. The confirmation is written
+ * right away unless responses are waiting, then it is queued in a recycled
+ * command */
+static void confirm_indication(struct _GAttrib *attrib)
+{
+    guint8 pdu = ATT_OP_HANDLE_CNF;
+    struct command *c;
+
+    if (g_queue_is_empty(attrib->responses) &&
+        send(g_io_channel_unix_get_fd(attrib->io), &pdu, sizeof(pdu),
+             MSG_DONTWAIT) == sizeof(pdu))
+        return;
+
+    c = command_new(attrib, sizeof(pdu));
+    if (c == NULL)
+        return;
+
+    c->pdu[0] = pdu;
+    c->len = sizeof(pdu);
+    command_queue(attrib, 0, c, NULL, NULL, NULL);
+}
+
+/* Give each value of a Multiple Handle Value Notification to the events of
+ * its handle, as a Handle Value Notification. Each one is rewritten in place
+ * over its Handle Length Value Tuple, unless the receive buffer is referenced
+ * (see g_attrib_ref_pdu()): the PDU is then copied in a scratch buffer so
+ * that the references keep the PDU as received */
+static void dispatch_notify_multi(struct _GAttrib *attrib, uint8_t *buf,
+                                  gsize len)
+{
+    uint8_t *scratch = NULL;
+    ssize_t next;
+    gsize offset;
+
+    for (offset = 1; offset < len; offset = next) {
+        const uint8_t *value;
+        uint16_t handle, vlen;
+        uint8_t *pdu;
+        GSList *l;
+
+        next = dec_notify_multi(buf, len, offset, &handle, &value, &vlen);
+        if (next < 0)
+            break;
+
+        if (attrib->rx_bytes != NULL) {
+            if (scratch == NULL)
+                scratch = g_malloc(len);
+            pdu = scratch;
+            memcpy(&pdu[3], value, vlen);
+        } else
+            pdu = &buf[offset + 1];
+        pdu[0] = ATT_OP_HANDLE_NOTIFY;
+        att_put_u16(handle, &pdu[1]);
+
+        l = g_hash_table_lookup(attrib->handle_events,
+                                GUINT_TO_POINTER(handle));
+        for (; l; l = l->next) {
+            struct event *evt = l->data;
+
+            if (evt->expected == ATT_OP_HANDLE_NOTIFY)
+                evt->func(pdu, vlen + 3, evt->user_data);
+        }
+
+        for (l = attrib->wildcard_events; l; l = l->next) {
+            struct event *evt = l->data;
+
+            if (evt->expected == ATT_OP_HANDLE_NOTIFY &&
+                evt->handle == GATTRIB_ALL_HANDLES)
+                evt->func(pdu, vlen + 3, evt->user_data);
+        }
+    }
+
+    g_free(scratch);
+}
+
 static gboolean received_data(GIOChannel *io, GIOCondition cond,
                               gpointer data)
 {
     struct _GAttrib *attrib = data;
     struct command *cmd = NULL;
     GSList *l;
-    uint8_t buf[512], status;
+    uint8_t *buf, status;
     gsize len;
     GIOStatus iostat;
+    gboolean keep = TRUE;
 
     if (attrib->stale)
         return FALSE;
@@ -420,38 +862,69 @@ static gboolean received_data(GIOChannel *io, GIOCondition cond,
         return FALSE;
     }
 
-    memset(buf, 0, sizeof(buf));
+    buf = rx_buffer_get(attrib)->data;
 
-    iostat = g_io_channel_read_chars(io, (char *) buf, sizeof(buf),
+    iostat = g_io_channel_read_chars(io, (char *) buf, attrib->rx->size,
                                      &len, NULL);
     if (iostat != G_IO_STATUS_NORMAL) {
         status = ATT_ECODE_IO;
         goto done;
     }
 
-    for (l = attrib->events; l; l = l->next) {
+    /* The events on the handle of the PDU are found directly, the ones on
+     * any handle or opcode are matched one by one */
+    if (len >= 3) {
+        l = g_hash_table_lookup(attrib->handle_events,
+                                GUINT_TO_POINTER(att_get_u16(&buf[1])));
+        if (buf[0] == ATT_OP_HANDLE_IND) {
+            GSList *e;
+
+            for (e = l; e; e = e->next) {
+                struct event *evt = e->data;
+
+                if (evt->expected == buf[0] && evt->auto_confirm) {
+                    confirm_indication(attrib);
+                    break;
+                }
+            }
+        }
+
+        for (; l; l = l->next) {
+            struct event *evt = l->data;
+
+            if (evt->expected == buf[0])
+                evt->func(buf, len, evt->user_data);
+        }
+    }
+
+    for (l = attrib->wildcard_events; l; l = l->next) {
         struct event *evt = l->data;
 
         if (match_event(evt, buf, len))
             evt->func(buf, len, evt->user_data);
     }
 
+    /* Once the events on the whole PDU are done */
+    if (buf[0] == ATT_OP_HANDLE_NOTIFY_MULTI)
+        dispatch_notify_multi(attrib, buf, len);
+
     if (!is_response(buf[0]))
-        return TRUE;
+        goto out;
 
     if (attrib->timeout_watch > 0) {
-        g_source_remove(attrib->timeout_watch);
+        attrib_remove_source(attrib, attrib->timeout_watch);
         attrib->timeout_watch = 0;
     }
 
     cmd = g_queue_pop_head(attrib->requests);
     if (cmd == NULL) {
         /* Keep the watch if we have events to report */
-        return attrib->events != NULL;
+        keep = attrib->events != NULL;
+        goto out;
     }
 
     if (buf[0] == ATT_OP_ERROR) {
-        status = buf[4];
+        status = (len > 4) ? buf[4] : ATT_ECODE_IO;
         goto done;
     }
 
@@ -474,20 +947,22 @@ done:
         command_destroy(cmd);
     }
 
-    return TRUE;
+out:
+    rx_buffer_done(attrib);
+    return keep;
 }
 
 GAttrib *g_attrib_new(GIOChannel *io)
 {
-    struct _GAttrib *attrib;
+    return g_attrib_new_full(io, NULL);
+}
+
+GAttrib *g_attrib_new_full(GIOChannel *io, GMainContext *context)
+{
     uint16_t imtu;
-    uint16_t att_mtu;
     uint16_t cid;
     GError *gerr = NULL;
 
-    g_io_channel_set_encoding(io, NULL, NULL);
-    g_io_channel_set_buffered(io, FALSE);
-
     bt_io_get(io, &gerr, BT_IO_OPT_IMTU, &imtu,
               BT_IO_OPT_CID, &cid, BT_IO_OPT_INVALID);
     if (gerr) {
@@ -496,23 +971,40 @@ GAttrib *g_attrib_new(GIOChannel *io)
         return NULL;
     }
 
+    return g_attrib_new_mtu(io, context,
+                            (cid == ATT_CID) ? ATT_DEFAULT_LE_MTU : imtu);
+}
+
+GAttrib *g_attrib_new_mtu(GIOChannel *io, GMainContext *context,
+                          uint16_t mtu)
+{
+    struct _GAttrib *attrib;
+
+    g_io_channel_set_encoding(io, NULL, NULL);
+    g_io_channel_set_buffered(io, FALSE);
+
     attrib = g_try_new0(struct _GAttrib, 1);
     if (attrib == NULL)
         return NULL;
 
-    att_mtu = (cid == ATT_CID) ? ATT_DEFAULT_LE_MTU : imtu;
-
-    attrib->buf = g_malloc0(att_mtu);
-    attrib->buflen = att_mtu;
+    attrib->buf = g_malloc0(mtu);
+    attrib->buflen = mtu;
 
     attrib->io = g_io_channel_ref(io);
+    if (context)
+        attrib->context = g_main_context_ref(context);
     attrib->requests = g_queue_new();
     attrib->responses = g_queue_new();
+    attrib->handle_events = g_hash_table_new(NULL, NULL);
+    attrib->uuid_events = g_hash_table_new(g_str_hash, g_str_equal);
+    attrib->rx_pool = rx_pool_new();
 
-    attrib->read_watch = g_io_add_watch(attrib->io,
-                                        G_IO_IN  | G_IO_HUP |
-                                        G_IO_ERR | G_IO_NVAL,
-                                        received_data, attrib);
+    attrib->read_watch = attrib_add_source(attrib,
+                                    g_io_create_watch(attrib->io,
+                                                      G_IO_IN  | G_IO_HUP |
+                                                      G_IO_ERR | G_IO_NVAL),
+                                    (GSourceFunc) received_data, attrib,
+                                    NULL);
 
     return g_attrib_ref(attrib);
 }
@@ -520,55 +1012,63 @@ GAttrib *g_attrib_new(GIOChannel *io)
 guint g_attrib_send(GAttrib *attrib, guint id, const guint8 *pdu, guint16 len,
                     GAttribResultFunc func, gpointer user_data,
                     GDestroyNotify notify)
+{
+    return g_attrib_send_data(attrib, id, pdu, len, NULL, 0, func, user_data,
+                              notify);
+}
+
+/* Queue a command whose PDU is set */
+guint g_attrib_send_data(GAttrib *attrib, guint id, const guint8 *pdu,
+                         guint16 len, const guint8 *data, guint16 data_len,
+                         GAttribResultFunc func, gpointer user_data,
+                         GDestroyNotify notify)
 {
     struct command *c;
-    GQueue *queue;
-    uint8_t opcode;
 
-    if (attrib->stale)
+    if (attrib->stale || len == 0)
         return 0;
 
-    c = g_try_new0(struct command, 1);
+    c = command_new(attrib, len);
     if (c == NULL)
         return 0;
 
-    opcode = pdu[0];
-
-    c->opcode = opcode;
-    c->expected = opcode2expected(opcode);
-    c->pdu = g_malloc(len);
     memcpy(c->pdu, pdu, len);
     c->len = len;
-    c->func = func;
-    c->user_data = user_data;
-    c->notify = notify;
+    c->data = data;
+    c->data_len = data_len;
 
-    if (is_response(opcode))
-        queue = attrib->responses;
-    else
-        queue = attrib->requests;
+    return command_queue(attrib, id, c, func, user_data, notify);
+}
 
-    if (id) {
-        c->id = id;
-        if (!is_response(opcode))
-            g_queue_push_head(queue, c);
-        else
-            /* Don't re-order responses even if an ID is given */
-            g_queue_push_tail(queue, c);
-    } else {
-        c->id = ++attrib->next_cmd_id;
-        g_queue_push_tail(queue, c);
+guint8 *g_attrib_reserve(GAttrib *attrib, size_t *len)
+{
+    struct command *c = attrib->reserved;
+
+    if (c == NULL || c->size < attrib->buflen) {
+        g_free(c);
+        c = attrib->reserved = command_new(attrib, attrib->buflen);
+        if (c == NULL)
+            return NULL;
     }
 
-    /*
-     * If a command was added to the queue and it was empty before, wake up
-     * the sender. If the sender was already woken up by the second queue,
-     * wake_up_sender will just return.
-     */
-    if (g_queue_get_length(queue) == 1)
-        wake_up_sender(attrib);
+    *len = attrib->buflen;
 
-    return c->id;
+    return c->pdu;
+}
+
+guint g_attrib_commit(GAttrib *attrib, guint id, guint16 len,
+                      GAttribResultFunc func, gpointer user_data,
+                      GDestroyNotify notify)
+{
+    struct command *c = attrib->reserved;
+
+    if (attrib->stale || c == NULL || len == 0 || len > c->size)
+        return 0;
+
+    attrib->reserved = NULL;
+    c->len = len;
+
+    return command_queue(attrib, id, c, func, user_data, notify);
 }
 
 static int command_cmp_by_id(gconstpointer a, gconstpointer b)
@@ -586,13 +1086,6 @@ static int event_cmp_by_handle(gconstpointer a, gconstpointer b)
     return (evt->handle - handle);
 }
 
-static int event_cmp_by_uuid(gconstpointer a, gconstpointer b)
-{
-    const struct event *evt      = a;
-    const        char  *uuid_str = b;
-    return  strcmp(evt->uuid_str, uuid_str);
-}
-
 gboolean g_attrib_cancel(GAttrib *attrib, guint id)
 {
     GList *l = NULL;
@@ -676,6 +1169,33 @@ gboolean g_attrib_set_debug(GAttrib *attrib,
     return TRUE;
 }
 
+GBytes *g_attrib_ref_pdu(GAttrib *attrib, const guint8 *pdu, gsize offset,
+                         gsize len)
+{
+    struct rx_buffer *rx;
+
+    if (attrib == NULL || attrib->rx == NULL)
+        return NULL;
+
+    /* pdu may be one of the values of a Multiple Handle Value
+     * Notification */
+    rx = attrib->rx;
+    if (pdu < rx->data || pdu >= rx->data + rx->size)
+        return NULL;
+
+    offset += pdu - rx->data;
+    if (offset + len > rx->size)
+        return NULL;
+
+    if (attrib->rx_bytes == NULL) {
+        g_atomic_int_inc(&attrib->rx_pool->refs);
+        attrib->rx_bytes = g_bytes_new_with_free_func(rx->data, rx->size,
+                                                      rx_buffer_release, rx);
+    }
+
+    return g_bytes_new_from_bytes(attrib->rx_bytes, offset, len);
+}
+
 uint8_t *g_attrib_get_buffer(GAttrib *attrib, size_t *len)
 {
     if (len == NULL)
@@ -695,6 +1215,9 @@ gboolean g_attrib_set_mtu(GAttrib *attrib, int mtu)
 
     attrib->buflen = mtu;
 
+    /* Too small for the new MTU */
+    free_commands(attrib);
+
     return TRUE;
 }
 
@@ -718,10 +1241,29 @@ guint g_attrib_register(GAttrib *attrib, guint8 opcode, char *uuid_str,
     event->id = ++next_evt_id;
 
     attrib->events = g_slist_append(attrib->events, event);
+    event_index(attrib, event);
 
     return event->id;
 }
 
+gboolean g_attrib_set_auto_confirm(GAttrib *attrib, char *uuid_str,
+                                   gboolean enable)
+{
+    GSList *l;
+
+    l = g_hash_table_lookup(attrib->uuid_events, uuid_str);
+    if (l == NULL)
+        return FALSE;
+
+    for (; l; l = l->next) {
+        struct event *evt = l->data;
+
+        evt->auto_confirm = enable;
+    }
+
+    return TRUE;
+}
+
 gboolean g_attrib_is_encrypted(GAttrib *attrib)
 {
     BtIOSecLevel sec_level;
@@ -744,13 +1286,13 @@ gboolean g_attrib_unregister(GAttrib *attrib, char *uuid_str)
         return FALSE;
     }
 
-    l = g_slist_find_custom(attrib->events, (gpointer) uuid_str,
-                            event_cmp_by_uuid);
+    l = g_hash_table_lookup(attrib->uuid_events, uuid_str);
     if (l == NULL)
         return FALSE;
 
     evt = l->data;
 
+    event_unindex(attrib, evt);
     attrib->events = g_slist_remove(attrib->events, evt);
 
     if (evt->notify)
@@ -768,6 +1310,8 @@ gboolean g_attrib_unregister_all(GAttrib *attrib)
     if (attrib->events == NULL)
         return FALSE;
 
+    event_index_clear(attrib);
+
     for (l = attrib->events; l; l = l->next) {
         struct event *evt = l->data;
 
@@ -804,8 +1348,13 @@ void event_list_print(GAttrib *attrib)
 
 char *event_get_uuid_by_handle(GAttrib *attrib, guint16 handle)
 {
-    GSList *l = g_slist_find_custom(attrib->events, GUINT_TO_POINTER(handle),
-                                    event_cmp_by_handle);
+    GSList *l = g_hash_table_lookup(attrib->handle_events,
+                                    GUINT_TO_POINTER(handle));
+
+    if (l == NULL)
+        l = g_slist_find_custom(attrib->wildcard_events,
+                                GUINT_TO_POINTER(handle),
+                                event_cmp_by_handle);
     if (l && l->data){
         struct event *event = l->data;
         return event->uuid_str;
@@ -815,10 +1364,5 @@ char *event_get_uuid_by_handle(GAttrib *attrib, guint16 handle)
 
 gboolean has_event_by_uuid(GAttrib *attrib, char *uuid_str)
 {
-    GSList *l = g_slist_find_custom(attrib->events, (gpointer) uuid_str,
-                                    event_cmp_by_handle);
-
-    if (l && l->data)
-        return TRUE;
-    return FALSE;
+    return g_hash_table_lookup(attrib->uuid_events, uuid_str) != NULL;
 }
@@ -39,10 +39,20 @@ extern "C" {
                                        guint16 len, gpointer user_data);
     typedef void (*GAttribDisconnectFunc)(gpointer user_data);
     typedef void (*GAttribDebugFunc)(const char *str, gpointer user_data);
+    /* The values of a Multiple Handle Value Notification are given to the
+     * events of ATT_OP_HANDLE_NOTIFY as one PDU each, after the events of
+     * ATT_OP_HANDLE_NOTIFY_MULTI got the whole PDU */
     typedef void (*GAttribNotifyFunc)(const guint8 *pdu, guint16 len,
                                       gpointer user_data);
 
     GAttrib *g_attrib_new(GIOChannel *io);
+    /* Same, with the IO watches attached to context instead of the default
+     * main context */
+    GAttrib *g_attrib_new_full(GIOChannel *io, GMainContext *context);
+    /* Same, for a channel of a known ATT MTU which may not be a Bluetooth
+     * socket */
+    GAttrib *g_attrib_new_mtu(GIOChannel *io, GMainContext *context,
+                              uint16_t mtu);
     GAttrib *g_attrib_ref(GAttrib *attrib);
     void g_attrib_unref(GAttrib *attrib);
 
@@ -56,6 +66,21 @@ extern "C" {
                         guint16 len, GAttribResultFunc func,
                         gpointer user_data, GDestroyNotify notify);
 
+    /* Same, the data_len bytes of data follow pdu in the same packet. data
+     * is not copied, it must stay valid until notify is called */
+    guint g_attrib_send_data(GAttrib *attrib, guint id, const guint8 *pdu,
+                             guint16 len, const guint8 *data,
+                             guint16 data_len, GAttribResultFunc func,
+                             gpointer user_data, GDestroyNotify notify);
+
+    /* Get the PDU of the next command, of len bytes (the MTU), to encode it
+     * in place, then queue it with g_attrib_commit: it is not copied. The
+     * same PDU is returned until it is committed */
+    guint8 *g_attrib_reserve(GAttrib *attrib, size_t *len);
+    guint g_attrib_commit(GAttrib *attrib, guint id, guint16 len,
+                          GAttribResultFunc func, gpointer user_data,
+                          GDestroyNotify notify);
+
     gboolean g_attrib_cancel(GAttrib *attrib, guint id);
     gboolean g_attrib_cancel_all(GAttrib *attrib);
 
@@ -64,6 +89,13 @@ extern "C" {
 
     gboolean g_attrib_is_encrypted(GAttrib *attrib);
 
+    /* From a callback given the received pdu, reference len bytes of it
+     * from offset without copying them. The whole receive buffer stays
+     * allocated until the last reference is released, from any thread.
+     * NULL if pdu is not in the receive buffer */
+    GBytes *g_attrib_ref_pdu(GAttrib *attrib, const guint8 *pdu,
+                             gsize offset, gsize len);
+
     uint8_t *g_attrib_get_buffer(GAttrib *attrib, size_t *len);
     gboolean g_attrib_set_mtu(GAttrib *attrib, int mtu);
 
@@ -71,6 +103,12 @@ extern "C" {
                             guint16 handle,  GAttribNotifyFunc func,
                             gpointer user_data, GDestroyNotify notify);
 
+    /* Confirm the indications of the events of uuid_str as they are
+     * received, before calling them. Only for the events on a given handle
+     * and opcode */
+    gboolean g_attrib_set_auto_confirm(GAttrib *attrib, char *uuid_str,
+                                       gboolean enable);
+
     gboolean g_attrib_unregister(GAttrib *attrib, char *uuid_str);
     gboolean g_attrib_unregister_all(GAttrib *attrib);
 
@@ -42,7 +42,8 @@
 
 GIOChannel *gatt_connect(const char *src, const char *dst,
                          const char *dst_type, const char *sec_level, int psm,
-                         int mtu, BtIOConnect connect_cb, gpointer user_data,
+                         int mtu, GMainContext *context,
+                         BtIOConnect connect_cb, gpointer user_data,
                          GError **gerr)
 {
     GIOChannel *chan;
@@ -83,6 +84,7 @@ GIOChannel *gatt_connect(const char *src, const char *dst,
                              BT_IO_OPT_DEST_TYPE, dest_type,
                              BT_IO_OPT_CID, ATT_CID,
                              BT_IO_OPT_SEC_LEVEL, sec,
+                             BT_IO_OPT_CONTEXT, context,
                              BT_IO_OPT_INVALID);
     else
         chan = bt_io_connect(connect_cb, user_data, NULL, &tmp_err,
@@ -91,6 +93,7 @@ GIOChannel *gatt_connect(const char *src, const char *dst,
                              BT_IO_OPT_PSM, psm,
                              BT_IO_OPT_IMTU, mtu,
                              BT_IO_OPT_SEC_LEVEL, sec,
+                             BT_IO_OPT_CONTEXT, context,
                              BT_IO_OPT_INVALID);
 
     if (tmp_err) {
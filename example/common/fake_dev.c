@@ -0,0 +1,79 @@
+/*
+ *  BlueLib - Abstraction layer for Bluetooth Low Energy softwares
+ *
+ *  Copyright (C) 2013  Netatmo
+ *  Copyright (C) 2014  Hubert Lefevre
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "callback.h"
+#include "fake_dev.h"
+
+static gpointer peripheral_thread(gpointer data)
+{
+    fake_dev_t *fake = data;
+    uint8_t     pdu[ATT_MAX_VALUE_LEN + 3];
+    ssize_t     len;
+
+    while ((len = read(fake->periph_fd, pdu, sizeof(pdu))) > 0)
+        if (fake->rx(fake, pdu, len))
+            break;
+
+    close(fake->periph_fd);
+    return NULL;
+}
+
+int fake_dev_init(fake_dev_t *fake, int idx, uint16_t mtu, fake_dev_rx_t *rx,
+                  void *user_data)
+{
+    char mac[MAC_SZ + 1];
+    int  fds[2];
+
+    snprintf(mac, sizeof(mac), "00:00:00:00:00:%02X", idx);
+    if (dev_init(&fake->dev_ctx, NULL, mac, NULL, 0, SECURITY_LEVEL_LOW))
+        return -1;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) < 0) {
+        perror("socketpair");
+        return -1;
+    }
+
+    fake->periph_fd = fds[1];
+    fake->rx        = rx;
+    fake->user_data = user_data;
+
+    fake->dev_ctx.iochannel = g_io_channel_unix_new(fds[0]);
+    g_io_channel_set_close_on_unref(fake->dev_ctx.iochannel, TRUE);
+    fake->dev_ctx.attrib = g_attrib_new_mtu(fake->dev_ctx.iochannel,
+                                            get_event_context(&fake->dev_ctx),
+                                            mtu);
+    fake->dev_ctx.conn_state = STATE_CONNECTED;
+
+    fake->periph_thread = g_thread_new("peripheral", peripheral_thread, fake);
+    return 0;
+}
+
+void fake_dev_stop(fake_dev_t *fake)
+{
+    bl_disconnect(&fake->dev_ctx);
+    g_thread_join(fake->periph_thread);
+}
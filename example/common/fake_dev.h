@@ -0,0 +1,56 @@
+/*
+ *  BlueLib - Abstraction layer for Bluetooth Low Energy softwares
+ *
+ *  Copyright (C) 2013  Netatmo
+ *  Copyright (C) 2014  Hubert Lefevre
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef _FAKE_DEV_H_
+#define _FAKE_DEV_H_
+
+#include <stdint.h>
+#include "bluelib.h"
+
+// Device of the benches: BlueLib talks over a socket pair to a fake
+// peripheral thread, no device is needed.
+typedef struct fake_dev fake_dev_t;
+
+// Called by the peripheral thread for each PDU sent by BlueLib, answers are
+// written to periph_fd. A non zero value stops the peripheral.
+typedef int (fake_dev_rx_t)(fake_dev_t *fake, const uint8_t *pdu,
+                            size_t len);
+
+// dev_ctx comes first: the device given back by BlueLib is the fake_dev_t.
+struct fake_dev {
+    dev_ctx_t      dev_ctx;
+    int            periph_fd;
+    GThread       *periph_thread;
+    fake_dev_rx_t *rx;
+    void          *user_data;
+};
+
+// Create the connected device number idx with the given MTU and start its
+// peripheral.
+int fake_dev_init(fake_dev_t *fake, int idx, uint16_t mtu, fake_dev_rx_t *rx,
+                  void *user_data);
+
+// Disconnect the device and wait for its peripheral.
+void fake_dev_stop(fake_dev_t *fake);
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ *  BlueLib - Abstraction layer for Bluetooth Low Energy softwares
+ *
+ *  Copyright (C) 2013  Netatmo
+ *  Copyright (C) 2014  Hubert Lefevre
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "bluelib.h"
+#include "callback.h"
+
+#define DEFAULT_NB_READS  1000
+#define DEFAULT_RADIO_MS  0
+
+static void usage(void)
+{
+    printf("Description: This program measures the time between the arrival "
+           "of an ATT response\non the event loop and the wake up of the thr"
+           "ead waiting for it. The responses\nare generated by a fake periph"
+           "eral running on the event loop, no device is\nneeded. With \"cont"
+           "ext\", BlueLib runs on the main thread context instead of\nits "
+           "own event loop thread.\nUsage: latency_test [number of reads] ["
+           "radio delay in ms] [thread|context]\n");
+}
+
+// Fake peripheral: answers a Read Request after the simulated radio delay.
+static gint64 response_time;
+
+static gboolean fake_peripheral_respond(gpointer user_data)
+{
+    uint8_t pdu[] = { ATT_OP_READ_RESP, 0x2a, 0x00 };
+
+    response_time = g_get_monotonic_time();
+    read_by_hnd_cb(0, pdu, sizeof(pdu), user_data);
+    return FALSE;
+}
+
+int main(int argc, char **argv)
+{
+    int       nb_reads = DEFAULT_NB_READS;
+    int       radio_ms = DEFAULT_RADIO_MS;
+    GError   *gerr     = NULL;
+    GMainContext *context = NULL;
+    dev_ctx_t dev_ctx;
+    gint64    min      = G_MAXINT64;
+    gint64    max      = 0;
+    gint64    total    = 0;
+    gint64    start;
+
+    if (argc > 4) {
+        usage();
+        return 0;
+    }
+    if (argc > 1)
+        nb_reads = atoi(argv[1]);
+    if (argc > 2)
+        radio_ms = atoi(argv[2]);
+    if (argc > 3) {
+        if (!strcmp(argv[3], "context"))
+            context = g_main_context_new();
+        else if (strcmp(argv[3], "thread")) {
+            usage();
+            return 0;
+        }
+    }
+    if ((nb_reads <= 0) || (radio_ms < 0)) {
+        usage();
+        return 0;
+    }
+
+    if ((context ? bl_init_with_context(context, &gerr) : bl_init(&gerr))) {
+        printf("ERROR: Unable to initalise BlueLib: %s\n", gerr->message);
+        g_error_free(gerr);
+        return -1;
+    }
+    memset(&dev_ctx, 0, sizeof(dev_ctx));
+    dev_ctx.conn_state = STATE_CONNECTED;
+    g_mutex_init(&dev_ctx.mtx);
+    resolve_event_context(&dev_ctx);
+
+    start = g_get_monotonic_time();
+    for (int i = 0; i < nb_reads; i++) {
+        bl_value_t *bl_value = NULL;
+        cb_ctx_t   *cb_ctx   = cb_ctx_new(&dev_ctx, NULL, NULL);
+        gint64      latency;
+
+        if (!cb_ctx) {
+            printf("ERROR: Malloc error\n");
+            bl_stop();
+            return -1;
+        }
+
+        // The reference is released by the callback.
+        GSource *source = g_timeout_source_new(radio_ms);
+        g_source_set_callback(source, fake_peripheral_respond,
+                              cb_ctx_ref(cb_ctx), NULL);
+        g_source_attach(source, context);
+        g_source_unref(source);
+
+        if (wait_for_cb(cb_ctx, (void **) &bl_value, &gerr)) {
+            printf("ERROR: %s\n", gerr->message);
+            g_error_free(gerr);
+            cb_ctx_unref(cb_ctx);
+            bl_stop();
+            return -1;
+        }
+        latency = g_get_monotonic_time() - response_time;
+        cb_ctx_unref(cb_ctx);
+        bl_value_free(bl_value);
+
+        total += latency;
+        min    = MIN(min, latency);
+        max    = MAX(max, latency);
+    }
+
+    printf("%d reads, radio delay %d ms, %s\n", nb_reads, radio_ms,
+           context ? "application context" : "event loop thread");
+    printf("Wake up latency: min %" G_GINT64_FORMAT " us, avg %"
+           G_GINT64_FORMAT " us, max %" G_GINT64_FORMAT " us\n",
+           min, total / nb_reads, max);
+    printf("Throughput: %.1f reads/s\n",
+           nb_reads * 1000000.0 / (g_get_monotonic_time() - start));
+
+    bl_stop();
+    if (context)
+        g_main_context_unref(context);
+    return 0;
+}
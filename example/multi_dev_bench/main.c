@@ -0,0 +1,186 @@
+/*
+ *  BlueLib - Abstraction layer for Bluetooth Low Energy softwares
+ *
+ *  Copyright (C) 2013  Netatmo
+ *  Copyright (C) 2014  Hubert Lefevre
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include "bluelib.h"
+#include "fake_dev.h"
+
+#define DEFAULT_NB_DEVICES 8
+#define DEFAULT_NB_WRITES  2000
+#define DEFAULT_SLOW_MS    1
+#define DEFAULT_NB_LOOPS   1
+#define MAX_DEVICES        255
+
+static void usage(void)
+{
+    printf("Description: This program measures the write request throughput "
+           "of several devices\nused at the same time, each one from its own "
+           "thread. The devices are fake\nperipherals answering on a socket "
+           "pair, no device is needed. The first device\nis slow: it answers "
+           "after the given delay. With \"global\", every request is\nmade "
+           "under a single mutex, which is what BlueLib used to do.\nUsage: "
+           "multi_dev_bench [number of devices] [writes per device] [slow dev"
+           "ice delay in ms]\n[device|global] [number of event loops]\n");
+}
+
+typedef struct {
+    fake_dev_t fake;
+    int        delay_ms;
+    GThread   *worker_thread;
+    gint64     elapsed;
+    int        nb_errors;
+} device_t;
+
+static int      nb_writes = DEFAULT_NB_WRITES;
+static gboolean global    = FALSE;
+static GMutex   global_mtx;
+
+// Fake peripheral: acknowledges every write request after its delay.
+static int peripheral_rx(fake_dev_t *fake, const uint8_t *pdu, size_t len)
+{
+    device_t *dev   = fake->user_data;
+    uint8_t   rsp[] = { ATT_OP_WRITE_RESP };
+
+    if (pdu[0] != ATT_OP_WRITE_REQ)
+        return 0;
+
+    if (dev->delay_ms)
+        g_usleep(dev->delay_ms * 1000);
+
+    return (write(fake->periph_fd, rsp, sizeof(rsp)) < 0);
+}
+
+static gpointer worker_thread(gpointer data)
+{
+    device_t *dev   = data;
+    uint8_t   value = 0x01;
+    bl_char_t bl_char;
+    gint64    start;
+
+    memset(&bl_char, 0, sizeof(bl_char));
+    bl_char.value_handle = 0x0003;
+
+    start = g_get_monotonic_time();
+    for (int i = 0; i < nb_writes; i++) {
+        int ret;
+
+        if (global)
+            g_mutex_lock(&global_mtx);
+        ret = bl_write_char_by_char(&dev->fake.dev_ctx, &bl_char, &value,
+                                    sizeof(value), WRITE_REQ);
+        if (global)
+            g_mutex_unlock(&global_mtx);
+
+        if (ret)
+            dev->nb_errors++;
+    }
+    dev->elapsed = g_get_monotonic_time() - start;
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int       nb_devices = DEFAULT_NB_DEVICES;
+    int       slow_ms    = DEFAULT_SLOW_MS;
+    int       nb_loops   = DEFAULT_NB_LOOPS;
+    GError   *gerr       = NULL;
+    device_t *devs;
+    gint64    fast_elapsed = 0;
+    int       nb_errors    = 0;
+
+    if (argc > 6) {
+        usage();
+        return 0;
+    }
+    if (argc > 1)
+        nb_devices = atoi(argv[1]);
+    if (argc > 2)
+        nb_writes = atoi(argv[2]);
+    if (argc > 3)
+        slow_ms = atoi(argv[3]);
+    if (argc > 4) {
+        if (!strcmp(argv[4], "global"))
+            global = TRUE;
+        else if (strcmp(argv[4], "device")) {
+            usage();
+            return 0;
+        }
+    }
+    if (argc > 5)
+        nb_loops = atoi(argv[5]);
+    if ((nb_devices < 2) || (nb_devices > MAX_DEVICES) || (nb_writes <= 0) ||
+        (slow_ms < 0) || (nb_loops <= 0)) {
+        usage();
+        return 0;
+    }
+
+    if (bl_init_pool(nb_loops, &gerr)) {
+        printf("ERROR: Unable to initalise BlueLib: %s\n", gerr->message);
+        g_error_free(gerr);
+        return -1;
+    }
+
+    devs = g_new0(device_t, nb_devices);
+    for (int i = 0; i < nb_devices; i++) {
+        devs[i].delay_ms = (i == 0) ? slow_ms : 0;
+        if (fake_dev_init(&devs[i].fake, i, ATT_DEFAULT_LE_MTU,
+                          peripheral_rx, &devs[i])) {
+            printf("ERROR: Unable to create device %d\n", i);
+            bl_stop();
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < nb_devices; i++)
+        devs[i].worker_thread = g_thread_new("worker", worker_thread,
+                                             &devs[i]);
+
+    for (int i = 0; i < nb_devices; i++) {
+        g_thread_join(devs[i].worker_thread);
+        nb_errors += devs[i].nb_errors;
+        if (i > 0)
+            fast_elapsed = MAX(fast_elapsed, devs[i].elapsed);
+    }
+
+    printf("%d devices, %d writes each, first device answers in %d ms, %d "
+           "event loop(s), %s lock\n", nb_devices, nb_writes, slow_ms,
+           nb_loops, global ? "global" : "per device");
+    printf("Slow device: %.1f writes/s\n",
+           nb_writes * 1000000.0 / devs[0].elapsed);
+    printf("Other devices: %.1f writes/s in total\n",
+           (nb_devices - 1) * nb_writes * 1000000.0 / fast_elapsed);
+    if (nb_errors)
+        printf("%d writes failed\n", nb_errors);
+
+    for (int i = 0; i < nb_devices; i++)
+        fake_dev_stop(&devs[i].fake);
+    g_free(devs);
+
+    bl_stop();
+    return 0;
+}
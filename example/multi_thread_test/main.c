@@ -23,6 +23,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "bluelib.h"
 #include <glib.h>
 #include <unistd.h>
@@ -33,18 +34,18 @@
 #define RETRY_MAX  7
 static void usage(void)
 {
-    printf("Description: This program make a get_ble_tree on two different de"
-           "vices, each get_ble_tree is made within two seperate threads.\nUs"
-           "age: ble_tree <MAC address 1> <MAC address 2> <file name 1> <file"
-           " name 2>\n");
+    printf("Description: This program make a get_ble_tree on two devices, eac"
+           "h get_ble_tree is made within two seperate threads. The two addre"
+           "sses can be the same, the threads then share the device.\nUsage:"
+           " ble_tree <MAC address 1> <MAC address 2> <file name 1> <file nam"
+           "e 2>\n");
 }
 
 static int   error_cnt = 0;
-static dev_ctx_t dev_ctx;
 
 // Return 0 if no errors
 // Returns 1 if function need to be called again
-static int check_errors(int thd_nb, int code)
+static int check_errors(int thd_nb, dev_ctx_t *dev_ctx, int code)
 {
     printf("[THD%d]Error code = %d\n", thd_nb, code);
     if (code != BL_NO_ERROR) {
@@ -86,7 +87,7 @@ static int check_errors(int thd_nb, int code)
                     printf("[THD%d] Next try in 10 seconds\n", thd_nb);
                     sleep(10);
                     printf("[THD%d] Try to reconnect\n", thd_nb);
-                    int ret = bl_connect(&dev_ctx);
+                    int ret = bl_connect(dev_ctx);
                     if ((ret != BL_NO_ERROR) &&
                         (ret != BL_ALREADY_CONNECTED_ERROR) &&
                         (ret != BL_NOT_NOTIFIABLE_ERROR )) {
@@ -121,12 +122,12 @@ static int check_errors(int thd_nb, int code)
     }
 }
 
-static int check_gerrors(int thd_nb, GError *gerr)
+static int check_gerrors(int thd_nb, dev_ctx_t *dev_ctx, GError *gerr)
 {
     int ret = 0;
     if (gerr) {
         printf("[THD%d] %s", thd_nb, gerr->message);
-        ret = check_errors(thd_nb, gerr->code);
+        ret = check_errors(thd_nb, dev_ctx, gerr->code);
         g_error_free(gerr);
         gerr = NULL;
     } else {
@@ -137,11 +138,10 @@ static int check_gerrors(int thd_nb, GError *gerr)
 
 
 
-static int get_ble_tree(const int thd_nb, char *mac,
+static int get_ble_tree(const int thd_nb, dev_ctx_t *dev_ctx,
                         const char *file_path)
 {
 
-    int      ret_int;
     GError  *gerr             = NULL;
     GSList  *bl_primary_list  = NULL;
     GSList  *bl_included_list = NULL;
@@ -152,25 +152,11 @@ static int get_ble_tree(const int thd_nb, char *mac,
     FILE  *file = fopen(file_path, "w");
     if (!file)
         return -1;
-    // Initialisation
-    bl_init(&gerr);
-    if (check_gerrors(thd_nb, gerr)) {
-        printf("[THD%d] ERROR: Unable to initalise BlueLib\n", thd_nb);
-        return -1;
-    }
-    dev_init(&dev_ctx, NULL, mac, NULL, 0, TEST_SEC_LEVEL);
-
-    do {
-        ret_int = bl_connect(&dev_ctx);
-    } while (check_errors(thd_nb, ret_int));
-
-    if (ret_int)
-        return -1;
 
     do {
-        bl_value = bl_read_char(&dev_ctx, GATT_CHARAC_DEVICE_NAME_STR, NULL,
+        bl_value = bl_read_char(dev_ctx, GATT_CHARAC_DEVICE_NAME_STR, NULL,
                                 &gerr);
-    } while(check_gerrors(thd_nb, gerr));
+    } while(check_gerrors(thd_nb, dev_ctx, gerr));
 
     printf("[THD%d] In progress\n", thd_nb);
     if (bl_value) {
@@ -183,14 +169,14 @@ static int get_ble_tree(const int thd_nb, char *mac,
     } else {
         printf("[THD%d] Impossible to retrieve the name of the device \n",
                thd_nb);
-        goto disconnect;
+        goto exit;
     }
 
     fprintf(file, "Handle |\n");
 
     do {
-        bl_primary_list  = bl_get_all_primary(&dev_ctx, NULL, &gerr);
-    } while (check_gerrors(thd_nb, gerr));
+        bl_primary_list  = bl_get_all_primary(dev_ctx, NULL, &gerr);
+    } while (check_gerrors(thd_nb, dev_ctx, gerr));
 
     printf("[THD%d].", thd_nb);
 
@@ -203,9 +189,9 @@ static int get_ble_tree(const int thd_nb, char *mac,
 
             // Get all included in the primary service
             do {
-                bl_included_list = bl_get_included(&dev_ctx, bl_primary,
+                bl_included_list = bl_get_included(dev_ctx, bl_primary,
                                                    &gerr);
-            } while (check_gerrors(thd_nb, gerr));
+            } while (check_gerrors(thd_nb, dev_ctx, gerr));
 
             if (bl_included_list) {
                 bl_included_list_fprint(file, bl_included_list);
@@ -215,9 +201,9 @@ static int get_ble_tree(const int thd_nb, char *mac,
 
             // Get all characteristics in the primary service
             do {
-                bl_char_list = bl_get_all_char_in_primary(&dev_ctx,
+                bl_char_list = bl_get_all_char_in_primary(dev_ctx,
                                                           bl_primary, &gerr);
-            } while (check_gerrors(thd_nb, gerr));
+            } while (check_gerrors(thd_nb, dev_ctx, gerr));
 
             if (bl_char_list) {
                 for (GSList *lc = bl_char_list; lc; lc = lc->next) {
@@ -233,10 +219,10 @@ static int get_ble_tree(const int thd_nb, char *mac,
                             next_bl_char = lc->next->data;
                         do {
                             bl_desc_list =
-                                bl_get_all_desc_by_char(&dev_ctx, bl_char,
+                                bl_get_all_desc_by_char(dev_ctx, bl_char,
                                                         next_bl_char,
                                                         bl_primary, &gerr);
-                        } while (check_gerrors(thd_nb, gerr));
+                        } while (check_gerrors(thd_nb, dev_ctx, gerr));
                     }
                     if (bl_desc_list)
                         bl_desc_list_fprint(file, bl_desc_list);
@@ -253,25 +239,22 @@ static int get_ble_tree(const int thd_nb, char *mac,
     }
     printf("[THD%d] All done!\n", thd_nb);
 
-disconnect:
+exit:
     if (file)
         fclose(file);
-    printf("[THD%d] Disconnecting\n", thd_nb);
-    bl_disconnect(&dev_ctx);
-    bl_stop();
     return 0;
 }
 
 typedef struct {
-    char *mac;
-    char *file_path;
+    dev_ctx_t *dev_ctx;
+    char      *file_path;
 } arg_t;
 
 static gpointer thd2(gpointer data)
 {
     arg_t *arg = data;
 
-    get_ble_tree(2, arg->mac, arg->file_path);
+    get_ble_tree(2, arg->dev_ctx, arg->file_path);
 
     g_thread_exit(0);
     return NULL;
@@ -287,15 +270,56 @@ int main(int argc, char **argv)
         usage();
         return 0;
     }
-    arg_t thd2_arg;
+    arg_t      thd2_arg;
+    dev_ctx_t  dev_ctx[2];
+    char      *file_path = argv[3];
+    GError    *gerr      = NULL;
+    GThread   *thread;
+    int        ret;
 
-    char *mac          = argv[1];
-    thd2_arg.mac       = argv[2];
-    char *file_path    = argv[3];
+    // Initialisation
+    if (bl_init(&gerr)) {
+        printf("ERROR: Unable to initalise BlueLib: %s\n", gerr->message);
+        g_error_free(gerr);
+        return -1;
+    }
+
+    // Requests can be made on a device from any thread, share the context
+    // when both threads use the same device.
+    memset(dev_ctx, 0, sizeof(dev_ctx));
+    dev_init(&dev_ctx[0], NULL, argv[1], NULL, 0, TEST_SEC_LEVEL);
+    thd2_arg.dev_ctx = &dev_ctx[0];
+    if (strcmp(argv[1], argv[2])) {
+        dev_init(&dev_ctx[1], NULL, argv[2], NULL, 0, TEST_SEC_LEVEL);
+        thd2_arg.dev_ctx = &dev_ctx[1];
+    }
     thd2_arg.file_path = argv[4];
-    GError *gerr       = NULL;
 
-    g_thread_try_new("Thread 2", thd2, &thd2_arg, &gerr);
+    for (int i = 0; i < 2; i++) {
+        int ret_int;
+
+        if ((i == 1) && (thd2_arg.dev_ctx == &dev_ctx[0]))
+            break;
+        do {
+            ret_int = bl_connect(&dev_ctx[i]);
+        } while (check_errors(i + 1, &dev_ctx[i], ret_int));
+    }
 
-    return get_ble_tree(1, mac, file_path);
+    thread = g_thread_try_new("Thread 2", thd2, &thd2_arg, &gerr);
+    if (thread == NULL) {
+        printf("ERROR: %s\n", gerr->message);
+        g_error_free(gerr);
+        bl_stop();
+        return -1;
+    }
+
+    ret = get_ble_tree(1, &dev_ctx[0], file_path);
+    g_thread_join(thread);
+
+    printf("Disconnecting\n");
+    bl_disconnect(&dev_ctx[0]);
+    if (thd2_arg.dev_ctx != &dev_ctx[0])
+        bl_disconnect(&dev_ctx[1]);
+    bl_stop();
+    return ret;
 }
@@ -0,0 +1,296 @@
+/*
+ *  BlueLib - Abstraction layer for Bluetooth Low Energy softwares
+ *
+ *  Copyright (C) 2013  Netatmo
+ *  Copyright (C) 2014  Hubert Lefevre
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include "bluelib.h"
+#include "fake_dev.h"
+
+#define DEFAULT_NB_DEVICES 4
+#define DEFAULT_NB_NOTIFS  20000
+#define DEFAULT_RING_SIZE  256
+#define DEFAULT_DELAY_US   0
+#define MAX_DEVICES        255
+#define NB_HANDLES         4
+#define POP_MAX            64
+
+// Handles of characteristic i: declaration, value, then its CCC.
+#define DECL_HANDLE(i)  (1 + 3 * (i))
+#define VALUE_HANDLE(i) (DECL_HANDLE(i) + 1)
+
+static void usage(void)
+{
+    printf("Description: This program pushes the notifications of several "
+           "devices to a single\nnotification ring and drains it from a "
+           "consumer thread, which sleeps the given\ndelay after each batch. "
+           "The devices are fake peripherals sending\nnotifications as fast "
+           "as they can on %d handles, no device is needed.\nUsage: "
+           "notif_ring_bench [number of devices] [notifications per handle]"
+           "\n[ring size] [drop-newest|drop-oldest|block|keep-latest] "
+           "[consumer delay in us]\n", NB_HANDLES);
+}
+
+typedef struct {
+    fake_dev_t fake;
+    GThread   *sender_thread;
+    // Last value popped for each handle, -1 for none.
+    gint64     last[NB_HANDLES];
+} device_t;
+
+static const char *policy_names[] = {
+    [BL_OVERFLOW_DROP_NEWEST] = "drop-newest",
+    [BL_OVERFLOW_DROP_OLDEST] = "drop-oldest",
+    [BL_OVERFLOW_BLOCK]       = "block",
+    [BL_OVERFLOW_KEEP_LATEST] = "keep-latest",
+};
+
+static int              nb_notifs = DEFAULT_NB_NOTIFS;
+static int              delay_us  = DEFAULT_DELAY_US;
+static bl_notif_ring_t *ring;
+static gint             nb_senders;
+
+// Fake peripheral: describes the CCC of each characteristic and accepts
+// every write request.
+static int peripheral_rx(fake_dev_t *fake, const uint8_t *pdu, size_t len)
+{
+    uint8_t  rsp[10];
+    size_t   rsp_len;
+    uint16_t decl;
+
+    switch (pdu[0]) {
+    case ATT_OP_FIND_INFO_REQ:
+        if (len < 5)
+            return 0;
+        // The CCC, then the next declaration which ends the discovery.
+        decl   = att_get_u16(&pdu[1]) - 1;
+        rsp[0] = ATT_OP_FIND_INFO_RESP;
+        rsp[1] = 0x01;
+        att_put_u16(decl + 2, &rsp[2]);
+        att_put_u16(0x2902, &rsp[4]);
+        att_put_u16(decl + 3, &rsp[6]);
+        att_put_u16(0x2803, &rsp[8]);
+        rsp_len = 10;
+        break;
+
+    case ATT_OP_WRITE_REQ:
+        rsp[0]  = ATT_OP_WRITE_RESP;
+        rsp_len = 1;
+        break;
+
+    default:
+        return 0;
+    }
+
+    return (write(fake->periph_fd, rsp, rsp_len) < 0);
+}
+
+// Sends nb_notifs notifications on each handle, numbered from 0.
+static gpointer sender_thread(gpointer data)
+{
+    device_t *dev = data;
+    uint8_t   pdu[7];
+
+    pdu[0] = ATT_OP_HANDLE_NOTIFY;
+    for (int n = 0; n < nb_notifs; n++) {
+        for (int i = 0; i < NB_HANDLES; i++) {
+            att_put_u16(VALUE_HANDLE(i), &pdu[1]);
+            att_put_u32(n, &pdu[3]);
+            if (write(dev->fake.periph_fd, pdu, sizeof(pdu)) < 0)
+                goto exit;
+        }
+    }
+exit:
+    g_atomic_int_add(&nb_senders, -1);
+    return NULL;
+}
+
+static guint64 total_received(device_t *devs, int nb_devices)
+{
+    bl_notif_stats_t stats;
+    guint64          total = 0;
+
+    for (int d = 0; d < nb_devices; d++)
+        for (int i = 0; i < NB_HANDLES; i++)
+            if (!bl_notif_ring_get_stats(ring, &devs[d].fake.dev_ctx,
+                                         VALUE_HANDLE(i), &stats))
+                total += stats.received;
+    return total;
+}
+
+int main(int argc, char **argv)
+{
+    int              nb_devices = DEFAULT_NB_DEVICES;
+    int              ring_size  = DEFAULT_RING_SIZE;
+    bl_overflow_t    policy     = BL_OVERFLOW_DROP_NEWEST;
+    GError          *gerr       = NULL;
+    device_t        *devs;
+    bl_notif_t       notifs[POP_MAX];
+    bl_notif_stats_t stats;
+    bl_notif_stats_t sum;
+    guint64          popped     = 0;
+    int              nb_empty   = 0;
+    int              nb_latest  = 0;
+    gint64           start, elapsed;
+
+    if (argc > 6) {
+        usage();
+        return 0;
+    }
+    if (argc > 1)
+        nb_devices = atoi(argv[1]);
+    if (argc > 2)
+        nb_notifs = atoi(argv[2]);
+    if (argc > 3)
+        ring_size = atoi(argv[3]);
+    if (argc > 4) {
+        policy = G_N_ELEMENTS(policy_names);
+        for (int i = 0; i < G_N_ELEMENTS(policy_names); i++)
+            if (!strcmp(argv[4], policy_names[i]))
+                policy = i;
+        if (policy == G_N_ELEMENTS(policy_names)) {
+            usage();
+            return 0;
+        }
+    }
+    if (argc > 5)
+        delay_us = atoi(argv[5]);
+    if ((nb_devices < 1) || (nb_devices > MAX_DEVICES) || (nb_notifs <= 0) ||
+        (ring_size <= 0) || (delay_us < 0)) {
+        usage();
+        return 0;
+    }
+
+    // A single event loop: it is the only producer of the ring.
+    if (bl_init(&gerr)) {
+        printf("ERROR: Unable to initalise BlueLib: %s\n", gerr->message);
+        g_error_free(gerr);
+        return -1;
+    }
+
+    ring = bl_notif_ring_new(ring_size);
+    devs = g_new0(device_t, nb_devices);
+    for (int d = 0; d < nb_devices; d++) {
+        if (fake_dev_init(&devs[d].fake, d, ATT_DEFAULT_LE_MTU,
+                          peripheral_rx, &devs[d])) {
+            printf("ERROR: Unable to create device %d\n", d);
+            bl_stop();
+            return -1;
+        }
+
+        for (int i = 0; i < NB_HANDLES; i++) {
+            char       uuid_str[MAX_LEN_UUID_STR];
+            bl_char_t *bl_char;
+            int        ret;
+
+            devs[d].last[i] = -1;
+            snprintf(uuid_str, sizeof(uuid_str), "ff%02x", i);
+            bl_char = bl_char_new(uuid_str, DECL_HANDLE(i),
+                                  ATT_CHAR_PROPER_NOTIFY, VALUE_HANDLE(i));
+            ret = bl_add_notif_ring(&devs[d].fake.dev_ctx, bl_char, NULL,
+                                    NULL, ring, policy,
+                                    ATT_OP_HANDLE_NOTIFY);
+            bl_char_free(bl_char);
+            if (ret) {
+                printf("ERROR: Unable to subscribe on device %d: %d\n", d,
+                       ret);
+                bl_stop();
+                return -1;
+            }
+        }
+    }
+
+    nb_senders = nb_devices;
+    start      = g_get_monotonic_time();
+    for (int d = 0; d < nb_devices; d++)
+        devs[d].sender_thread = g_thread_new("sender", sender_thread,
+                                             &devs[d]);
+
+    // Consumer: stops once everything sent is received and the ring stays
+    // empty.
+    for (;;) {
+        size_t nb = bl_notif_ring_pop(ring, notifs, POP_MAX);
+
+        for (size_t n = 0; n < nb; n++) {
+            fake_dev_t *fake = (fake_dev_t *) notifs[n].dev_ctx;
+            device_t   *dev  = fake->user_data;
+            int         i    = (notifs[n].handle - VALUE_HANDLE(0)) / 3;
+
+            dev->last[i] = att_get_u32(g_bytes_get_data(notifs[n].value,
+                                                        NULL));
+            g_bytes_unref(notifs[n].value);
+        }
+        popped += nb;
+
+        if (nb) {
+            nb_empty = 0;
+            if (delay_us)
+                g_usleep(delay_us);
+        } else if (!g_atomic_int_get(&nb_senders) &&
+                   (total_received(devs, nb_devices) ==
+                    (guint64) nb_devices * NB_HANDLES * nb_notifs)) {
+            // The last one may still be on its way to the ring.
+            if (++nb_empty > 10)
+                break;
+            g_usleep(1000);
+        } else
+            g_usleep(100);
+    }
+    elapsed = g_get_monotonic_time() - start;
+
+    memset(&sum, 0, sizeof(sum));
+    for (int d = 0; d < nb_devices; d++) {
+        g_thread_join(devs[d].sender_thread);
+        for (int i = 0; i < NB_HANDLES; i++) {
+            if (!bl_notif_ring_get_stats(ring, &devs[d].fake.dev_ctx,
+                                         VALUE_HANDLE(i), &stats)) {
+                sum.received  += stats.received;
+                sum.dropped   += stats.dropped;
+                sum.conflated += stats.conflated;
+                sum.blocked   += stats.blocked;
+            }
+            if (devs[d].last[i] == nb_notifs - 1)
+                nb_latest++;
+        }
+    }
+
+    printf("%d devices, %d notifications per handle, ring of %d, %s, "
+           "consumer delay %d us\n", nb_devices, nb_notifs, ring_size,
+           policy_names[policy], delay_us);
+    printf("Received %u, popped %" G_GUINT64_FORMAT " (%.1f/s), dropped %u, "
+           "conflated %u, blocked %u\n", sum.received, popped,
+           popped * 1000000.0 / elapsed, sum.dropped, sum.conflated,
+           sum.blocked);
+    printf("Last value popped on %d of %d handles\n", nb_latest,
+           nb_devices * NB_HANDLES);
+
+    for (int d = 0; d < nb_devices; d++)
+        fake_dev_stop(&devs[d].fake);
+    bl_notif_ring_free(ring);
+    g_free(devs);
+    bl_stop();
+    return 0;
+}
@@ -0,0 +1,192 @@
+/*
+ *  BlueLib - Abstraction layer for Bluetooth Low Energy softwares
+ *
+ *  Copyright (C) 2013  Netatmo
+ *  Copyright (C) 2014  Hubert Lefevre
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "bluelib.h"
+#include "fake_dev.h"
+
+#define DEFAULT_NB_DEVICES 8
+#define DEFAULT_MTU        247
+#define MAX_DEVICES        255
+
+static void usage(void)
+{
+    printf("Description: This program uploads a file to several devices at "
+           "once with Write\nCommands, the way a firmware update is pushed, "
+           "and measures the throughput.\nThe devices are fake peripherals "
+           "answering on a socket pair, no device is\nneeded. With \"map\", "
+           "the file is sent from its memory mapping, with \"copy\"\nit is "
+           "read into the commands piece by piece.\nUsage: ota_bench <file> "
+           "[number of devices] [window] [mtu] [map|copy]\n");
+}
+
+typedef struct {
+    fake_dev_t   fake;
+    size_t       received;
+    FILE        *file;
+    bl_future_t *future;
+    double       bytes_per_s;
+} device_t;
+
+// Fake peripheral: counts the bytes of the write commands.
+static int peripheral_rx(fake_dev_t *fake, const uint8_t *pdu, size_t len)
+{
+    device_t *dev = fake->user_data;
+
+    if ((pdu[0] == ATT_OP_WRITE_CMD) && (len > 3))
+        dev->received += len - 3;
+    return 0;
+}
+
+static ssize_t file_read(uint8_t *buf, size_t size, void *user_data)
+{
+    FILE *file = user_data;
+
+    return fread(buf, 1, size, file);
+}
+
+static void progress(dev_ctx_t *dev_ctx, unsigned int req_id, size_t written,
+                     double bytes_per_s, void *user_data)
+{
+    device_t *dev = user_data;
+
+    dev->bytes_per_s = bytes_per_s;
+}
+
+int main(int argc, char **argv)
+{
+    int          nb_devices = DEFAULT_NB_DEVICES;
+    int          window     = BL_DEFAULT_WRITE_WINDOW;
+    int          mtu        = DEFAULT_MTU;
+    gboolean     map        = TRUE;
+    GError      *gerr       = NULL;
+    bl_char_t    bl_char;
+    device_t    *devs;
+    bl_future_t **futures;
+    gint64       start, elapsed;
+    size_t       total      = 0;
+    int          nb_errors  = 0;
+
+    if ((argc < 2) || (argc > 6)) {
+        usage();
+        return 0;
+    }
+    if (argc > 2)
+        nb_devices = atoi(argv[2]);
+    if (argc > 3)
+        window = atoi(argv[3]);
+    if (argc > 4)
+        mtu = atoi(argv[4]);
+    if (argc > 5) {
+        if (!strcmp(argv[5], "copy"))
+            map = FALSE;
+        else if (strcmp(argv[5], "map")) {
+            usage();
+            return 0;
+        }
+    }
+    if ((nb_devices < 1) || (nb_devices > MAX_DEVICES) || (window <= 0) ||
+        (mtu < ATT_DEFAULT_LE_MTU) || (mtu > ATT_MAX_VALUE_LEN + 3)) {
+        usage();
+        return 0;
+    }
+
+    if (bl_init(&gerr)) {
+        printf("ERROR: Unable to initalise BlueLib: %s\n", gerr->message);
+        g_error_free(gerr);
+        return -1;
+    }
+
+    memset(&bl_char, 0, sizeof(bl_char));
+    bl_char.value_handle = 0x0003;
+
+    devs    = g_new0(device_t, nb_devices);
+    futures = g_new0(bl_future_t *, nb_devices);
+    for (int i = 0; i < nb_devices; i++) {
+        if (fake_dev_init(&devs[i].fake, i, mtu, peripheral_rx, &devs[i])) {
+            printf("ERROR: Unable to create device %d\n", i);
+            bl_stop();
+            return -1;
+        }
+        if (!map && !(devs[i].file = fopen(argv[1], "r"))) {
+            perror(argv[1]);
+            bl_stop();
+            return -1;
+        }
+    }
+
+    start = g_get_monotonic_time();
+    for (int i = 0; i < nb_devices; i++) {
+        if (map)
+            futures[i] = bl_write_file_future(&devs[i].fake.dev_ctx,
+                                              &bl_char, argv[1], 0, window,
+                                              progress, &devs[i], &gerr);
+        else
+            futures[i] = bl_write_stream_future(&devs[i].fake.dev_ctx,
+                                                &bl_char, file_read,
+                                                devs[i].file, window,
+                                                progress, &devs[i], &gerr);
+        if (futures[i] == NULL) {
+            printf("ERROR: %s", gerr->message);
+            g_clear_error(&gerr);
+            nb_errors++;
+        }
+    }
+
+    bl_future_wait_all(futures, nb_devices, -1);
+    for (int i = 0; i < nb_devices; i++) {
+        if (futures[i] == NULL)
+            continue;
+        if (bl_future_get_result(futures[i], NULL, &gerr)) {
+            printf("ERROR: Device %d: %s", i, gerr->message);
+            g_clear_error(&gerr);
+            nb_errors++;
+        }
+        bl_future_free(futures[i]);
+    }
+    elapsed = g_get_monotonic_time() - start;
+
+    for (int i = 0; i < nb_devices; i++) {
+        fake_dev_stop(&devs[i].fake);
+        total += devs[i].received;
+        if (devs[i].file)
+            fclose(devs[i].file);
+    }
+
+    printf("%d devices, window of %d commands, MTU %d, %s\n", nb_devices,
+           window, mtu, map ? "mapped file" : "copied file");
+    printf("First device: %.1f bytes/s\n", devs[0].bytes_per_s);
+    printf("Total: %zu bytes received, %.1f bytes/s\n", total,
+           total * 1000000.0 / elapsed);
+    if (nb_errors)
+        printf("%d uploads failed\n", nb_errors);
+
+    g_free(futures);
+    g_free(devs);
+    bl_stop();
+    return 0;
+}
@@ -25,6 +25,7 @@
 #define _BLUELIB_H_
 
 #include <stdint.h>
+#include <sys/types.h>
 #include <glib.h>
 #include <errno.h>
 
@@ -61,6 +62,9 @@ GQuark bl_error_domain(void);
 #define BL_PROTOCOL_ERROR             -17
 #define BL_NOT_NOTIFIABLE_ERROR       -18
 #define BL_NOT_INDICABLE_ERROR        -19
+#define BL_CANCELLED_ERROR            -20
+#define BL_PENDING_ERROR              -21
+#define BL_TIMEOUT_ERROR              -22
 #define BL_NO_CTX_ERROR                -5
 
 #define INVALID_HANDLE             0x0000
@@ -113,16 +117,40 @@ typedef enum {
 
 // Bluelib device context
 typedef struct {
+    GMutex      mtx; // Protects attrib, the request queue and table.
     GAttrib    *attrib;
     GIOChannel *iochannel;
     int         opt_mtu;
 
+    // Requests submitted by any thread, waiting to be sent by the event loop
+    // of the device.
+    GQueue      req_queue;
+    gboolean    req_scheduled;
+
+    // Requests sent and not completed yet, by request id.
+    GHashTable *pending_reqs;
+
+    // Context of the event loop of the device, NULL for the default one.
+    GMainContext *context;
+
     char       *opt_mac_src;
     char       *opt_mac_dst;
     char       *opt_mac_dst_type;
     char       *opt_sec_level;
     int         opt_psm;
 
+    // Deadline of every request, 0 for none.
+    int         opt_timeout_ms;
+
+    // Event loop of the device, -1 to choose it from opt_mac_dst.
+    int         opt_loop;
+
+    // MTU asked for right after connecting, 0 for none.
+    int         opt_auto_mtu;
+
+    // Values received reference the receive buffer instead of a copy.
+    gboolean    opt_zero_copy;
+
     // User specific connection callback.
     user_cb_fct_t *connect_cb_fct;
 
@@ -143,17 +171,66 @@ typedef enum {
     WRITE_CMD,  // Command: no ACK in return.
 } write_type_t;
 
+// Completion function of the asynchronous requests (bl_*_async).
+// On success gerr is NULL and result is what the blocking equivalent of the
+// request would have returned (NULL for the writes, the connection and the
+// MTU exchange), you have to free it. On failure gerr is set, it is freed
+// after the call.
+// It is called from the event loop thread: do not call any blocking
+// function of BlueLib from it.
+typedef void (bl_req_cb_t)(dev_ctx_t *dev_ctx, unsigned int req_id,
+                           void *result, GError *gerr, void *user_data);
+
+// Function given the results of a streaming request part by part, as the
+// responses arrive, from the event loop thread. The list belongs to you.
+typedef void (bl_stream_cb_t)(dev_ctx_t *dev_ctx, unsigned int req_id,
+                              GSList *list, void *user_data);
+
+// Function given a long value part by part, as the responses arrive, from
+// the event loop thread. data holds the size bytes found at offset in the
+// value, it is only valid during the call.
+typedef void (bl_chunk_cb_t)(dev_ctx_t *dev_ctx, unsigned int req_id,
+                             size_t offset, const uint8_t *data, size_t size,
+                             void *user_data);
+
+// Source of a streaming write: fill buf with at most size bytes and return
+// how many were given, 0 at the end of the stream or < 0 to abort it.
+// Called from the event loop thread.
+typedef ssize_t (bl_write_src_t)(uint8_t *buf, size_t size, void *user_data);
+
+// Progress of a streaming write: written bytes have been given to the socket
+// so far, at bytes_per_s on average. Called from the event loop thread.
+typedef void (bl_progress_cb_t)(dev_ctx_t *dev_ctx, unsigned int req_id,
+                                size_t written, double bytes_per_s,
+                                void *user_data);
+
+// Handle on a pending request, see the Futures section.
+typedef struct cb_ctx bl_future_t;
+
 /****************************** BlueLib control *****************************/
 // Initializes the global context and the callback thread.
 int bl_init(GError **gerr);
 
-// Stop callback thread.
+// Same with nb_loops callback threads, each one running its own event loop
+// for a share of the devices. The callbacks of a device are always called
+// from the same thread, the one of its event loop.
+int bl_init_pool(int nb_loops, GError **gerr);
+
+// Same, but without callback thread: every BlueLib event source is attached
+// to context, the callbacks are called from the thread running it. The
+// blocking functions can be called from that thread, they run the context
+// while waiting.
+int bl_init_with_context(GMainContext *context, GError **gerr);
+
+// Stop callback thread, or detach from the context of the application.
 void bl_stop(void);
 
 
 /********************** Initialisation of the context **********************/
 // NOTE: You must provide at least dev_ctx and mac_src. You can set by default
 // the rest at NULL or 0.
+// The device is bound to an event loop here, initialise it again if BlueLib
+// is restarted.
 int dev_init(dev_ctx_t *dev_ctx, char *dev_src, char *mac_dst,
              char *mac_dst_type, int psm, sec_level_t sec_level);
 
@@ -171,6 +248,41 @@ int bl_disconnect(dev_ctx_t *dev_ctx);
 int bl_set_connect_cb(dev_ctx_t *dev_ctx, user_cb_fct_t *func);
 
 
+// Set the deadline of the requests sent to this device, in milliseconds. A
+// request that gets no answer in time fails with BL_TIMEOUT_ERROR, the
+// connection is kept. It bounds the connection too: bl_connect then fails
+// with BL_TIMEOUT_ERROR and the link is closed. 0 disables it, default is
+// BL_DEFAULT_TIMEOUT_MS.
+// NOTE: Only one request can be sent at a time on an ATT bearer, the
+// following ones stay queued until the response to the expired one arrives
+// or the ATT timeout (30 s) closes the link. An expired request that was not
+// sent yet is removed from the queue.
+#define BL_DEFAULT_TIMEOUT_MS 30000
+int bl_set_request_timeout(dev_ctx_t *dev_ctx, int timeout_ms);
+
+// Exchange the MTU right after each connection, before bl_connect returns,
+// asking for mtu: BL_MAX_MTU for the largest one. The connection succeeds
+// even if the device refuses, the default MTU is then kept. If no answer
+// comes within the connection deadline (see bl_set_request_timeout) or the
+// ATT timeout, the connection fails and the link is closed. 0 disables it
+// (default). Only for LE transport.
+// Longest value with the header of a Prepare Write Request.
+#define BL_MAX_MTU (ATT_MAX_VALUE_LEN + 5)
+int bl_set_auto_mtu(dev_ctx_t *dev_ctx, int mtu);
+
+// Hand out the values read from this device, and the notification values
+// taken with bl_notif_value_ref, as references to the buffer they were
+// received in instead of copies (bl_value_t.bytes is set). Each buffer
+// stays allocated, at the size of the MTU, until its last value is freed.
+// Disabled by default.
+int bl_set_zero_copy(dev_ctx_t *dev_ctx, gboolean enable);
+
+// Choose the event loop of the device when started with bl_init_pool, -1 to
+// select it from the hash of the device address (default). It can only be
+// changed while disconnected.
+int bl_set_loop_affinity(dev_ctx_t *dev_ctx, int loop);
+
+
 /********************* Get the state of the connection *********************/
 conn_state_t get_conn_state(dev_ctx_t *dev_ctx);
 
@@ -254,7 +366,8 @@ GSList *bl_get_all_desc_by_char(dev_ctx_t *dev_ctx, bl_char_t *start_bl_char,
 bl_value_t *bl_read_char(dev_ctx_t *dev_ctx, char *uuid_str,
                          bl_primary_t *bl_primary, GError **gerr);
 
-// Read all the characteristics value associated to this UUID.
+// Read all the characteristics value associated to this UUID, over as many
+// requests as needed.
 // Return a list of values (bl_value_t *).
 GSList *bl_read_char_all(dev_ctx_t *dev_ctx, char *uuid_str,
                          bl_primary_t *bl_primary, GError **gerr);
@@ -297,6 +410,48 @@ bl_value_t *bl_read_desc_by_char(dev_ctx_t *dev_ctx, bl_char_t *start_bl_char,
                                  char *desc_uuid_str, GError **gerr);
 
 
+/******************************* Long read *********************************/
+// Read a characteristic value with Read Blob Requests, straight into buf of
+// size bytes: nothing is allocated. The reading stops once buf is full.
+// Returns the size of the value read, cut at size, or -1 with gerr set.
+ssize_t bl_read_long(dev_ctx_t *dev_ctx, bl_char_t *bl_char, uint8_t *buf,
+                     size_t size, GError **gerr);
+
+// Same, but chunk is given each part of the value as it arrives instead,
+// along with user_data.
+int bl_read_long_stream(dev_ctx_t *dev_ctx, bl_char_t *bl_char,
+                        bl_chunk_cb_t *chunk, void *user_data);
+
+
+/************************** Read multiple values ***************************/
+// Read the values of nb attributes given by their handles with as few
+// requests as possible: the handles are packed into Read Multiple Requests
+// up to the MTU, and split over several requests if needed.
+// sizes gives the size of each value, the response is cut with it. If sizes
+// is NULL, Read Multiple Variable Length Requests are used instead, they
+// need a device supporting Bluetooth 5.2.
+// Returns a list of values (bl_value_t *), in the order of the handles.
+GSList *bl_read_multi(dev_ctx_t *dev_ctx, uint16_t *handles, size_t *sizes,
+                      int nb, GError **gerr);
+
+// Attribute to read with bl_read_plan.
+typedef struct {
+    uint16_t  handle;
+    size_t    size;     // Size of the value if known, else 0.
+    char     *uuid_str; // Type of the attribute if known, else NULL.
+} bl_read_item_t;
+
+// Read the values of nb attributes with as few round trips as possible:
+// the ones of known size are batched in Read Multiple Requests, the ones of
+// unknown size sharing a type are read with Read By Type Requests over their
+// handle range, the others with Read Requests, continued with Read Blob
+// Requests for the long values. Every request is queued at once. The values
+// missing or possibly truncated are read again with Read Requests.
+// Returns a list of values (bl_value_t *), in the order of the items.
+GSList *bl_read_plan(dev_ctx_t *dev_ctx, bl_read_item_t *items, int nb,
+                     GError **gerr);
+
+
 /************************** Write characteristic value *********************/
 // Write a characteristic value by UUID on a primary service
 int bl_write_char(dev_ctx_t *dev_ctx, char *uuid_str, bl_primary_t *bl_primary,
@@ -307,6 +462,37 @@ int bl_write_char_by_char(dev_ctx_t *dev_ctx, bl_char_t *bl_char,
                           uint8_t *value, size_t size, write_type_t  type);
 
 
+/***************************** Streaming write *****************************/
+// Write a stream of bytes to a characteristic with Write Commands. src is
+// asked for the data MTU - 3 bytes at a time, each piece is sent in its own
+// command. At most window commands are queued at once, the next pieces are
+// asked for as the previous ones are given to the socket, so the transfer
+// goes at the pace of the link without flooding the queue. progress, if not
+// NULL, is called after each piece. The request deadline is restarted after
+// each piece, it is an inactivity timeout. src is given src_data and
+// progress is given progress_data.
+// window <= 0 selects BL_DEFAULT_WRITE_WINDOW.
+#define BL_DEFAULT_WRITE_WINDOW 8
+int bl_write_stream(dev_ctx_t *dev_ctx, bl_char_t *bl_char,
+                    bl_write_src_t *src, void *src_data, int window,
+                    bl_progress_cb_t *progress, void *progress_data);
+
+// Same with the size bytes of data as stream. data can be released once the
+// call returns, each command holds a copy of its piece.
+int bl_write_data(dev_ctx_t *dev_ctx, bl_char_t *bl_char, uint8_t *data,
+                  size_t size, int window, bl_progress_cb_t *progress,
+                  void *progress_data);
+
+// Same with the file at path from offset on, e.g. a firmware image. The file
+// is mapped in memory and sent from there without being copied. To resume
+// an interrupted upload, start again at offset plus the last written value
+// given to progress: Write Commands are not acknowledged, these bytes were
+// only given to the socket.
+int bl_write_file(dev_ctx_t *dev_ctx, bl_char_t *bl_char, const char *path,
+                  size_t offset, int window, bl_progress_cb_t *progress,
+                  void *progress_data);
+
+
 /**************************** Write descriptor *****************************/
 // Write a descriptor of a characteristic by UUID on a primary service.
 int bl_write_desc(dev_ctx_t *dev_ctx, char *char_uuid_str,
@@ -333,6 +519,208 @@ int bl_change_sec_level(dev_ctx_t *dev_ctx, const sec_level_t level);
 int bl_change_mtu(dev_ctx_t *dev_ctx, int value);
 
 
+/************************** Asynchronous requests **************************/
+// Non-blocking equivalents of the requests above. They queue the request and
+// return its id, or 0 with gerr set if it is invalid. func is called with
+// the results once the request is completed, possibly before the function
+// returned, with BL_SEND_REQUEST_ERROR if it could not be sent. Several
+// requests can be pending at the same time, they are sent one after the
+// other.
+// The connection callback set with bl_set_connect_cb is not called by
+// bl_connect_async.
+unsigned int bl_connect_async(dev_ctx_t *dev_ctx, bl_req_cb_t *func,
+                              void *user_data, GError **gerr);
+
+unsigned int bl_get_all_primary_async(dev_ctx_t *dev_ctx, char *uuid_str,
+                                      bl_req_cb_t *func, void *user_data,
+                                      GError **gerr);
+
+unsigned int bl_get_included_async(dev_ctx_t *dev_ctx,
+                                   bl_primary_t *bl_primary,
+                                   bl_req_cb_t *func, void *user_data,
+                                   GError **gerr);
+
+unsigned int bl_get_all_char_async(dev_ctx_t *dev_ctx, char *uuid_str,
+                                   bl_primary_t *bl_primary,
+                                   bl_req_cb_t *func, void *user_data,
+                                   GError **gerr);
+
+unsigned int bl_get_all_desc_by_char_async(dev_ctx_t *dev_ctx,
+                                           bl_char_t *start_bl_char,
+                                           bl_char_t *end_bl_char,
+                                           bl_primary_t *bl_primary,
+                                           bl_req_cb_t *func,
+                                           void *user_data, GError **gerr);
+
+unsigned int bl_read_char_all_async(dev_ctx_t *dev_ctx, char *uuid_str,
+                                    bl_primary_t *bl_primary,
+                                    bl_req_cb_t *func, void *user_data,
+                                    GError **gerr);
+
+// Same, but stream is given the values of each response as they arrive, the
+// result given to func is then NULL. func may be NULL.
+unsigned int bl_read_char_all_stream(dev_ctx_t *dev_ctx, char *uuid_str,
+                                     bl_primary_t *bl_primary,
+                                     bl_stream_cb_t *stream,
+                                     bl_req_cb_t *func, void *user_data,
+                                     GError **gerr);
+
+unsigned int bl_read_char_by_char_async(dev_ctx_t *dev_ctx,
+                                        bl_char_t *bl_char,
+                                        bl_req_cb_t *func, void *user_data,
+                                        GError **gerr);
+
+unsigned int bl_read_desc_by_desc_async(dev_ctx_t *dev_ctx,
+                                        bl_desc_t *bl_desc,
+                                        bl_req_cb_t *func, void *user_data,
+                                        GError **gerr);
+
+// chunk is given each part of the value, the result given to func is NULL.
+unsigned int bl_read_long_async(dev_ctx_t *dev_ctx, bl_char_t *bl_char,
+                                bl_chunk_cb_t *chunk, bl_req_cb_t *func,
+                                void *user_data, GError **gerr);
+
+unsigned int bl_read_multi_async(dev_ctx_t *dev_ctx, uint16_t *handles,
+                                 size_t *sizes, int nb, bl_req_cb_t *func,
+                                 void *user_data, GError **gerr);
+
+// For a write command, func is called once the command is sent.
+unsigned int bl_write_char_by_char_async(dev_ctx_t *dev_ctx,
+                                         bl_char_t *bl_char, uint8_t *value,
+                                         size_t size, write_type_t type,
+                                         bl_req_cb_t *func, void *user_data,
+                                         GError **gerr);
+
+// func is given user_data, src and progress keep their own data.
+unsigned int bl_write_stream_async(dev_ctx_t *dev_ctx, bl_char_t *bl_char,
+                                   bl_write_src_t *src, void *src_data,
+                                   int window, bl_progress_cb_t *progress,
+                                   void *progress_data, bl_req_cb_t *func,
+                                   void *user_data, GError **gerr);
+
+unsigned int bl_write_file_async(dev_ctx_t *dev_ctx, bl_char_t *bl_char,
+                                 const char *path, size_t offset, int window,
+                                 bl_progress_cb_t *progress,
+                                 void *progress_data, bl_req_cb_t *func,
+                                 void *user_data, GError **gerr);
+
+unsigned int bl_write_desc_by_desc_async(dev_ctx_t *dev_ctx,
+                                         bl_desc_t *bl_desc, uint8_t *value,
+                                         size_t size, bl_req_cb_t *func,
+                                         void *user_data, GError **gerr);
+
+unsigned int bl_change_mtu_async(dev_ctx_t *dev_ctx, int value,
+                                 bl_req_cb_t *func, void *user_data,
+                                 GError **gerr);
+
+// Cancel a pending request given its id: it is completed at once with
+// BL_CANCELLED_ERROR. If it is still queued it is removed from the queue, if
+// it was already sent its response will be ignored.
+// Returns EINVAL if the request is not pending.
+int bl_cancel(dev_ctx_t *dev_ctx, unsigned int req_id);
+
+// Cancel every pending request of the device.
+int bl_cancel_all(dev_ctx_t *dev_ctx);
+
+
+/********************************* Futures *********************************/
+// Same requests again, returning a future instead of calling a function.
+// Start as many requests as you need, on one or several devices, then gather
+// the results with the bl_future_wait functions. Every future returned must
+// be released with bl_future_free. NULL is returned with gerr set if the
+// request is invalid.
+bl_future_t *bl_connect_future(dev_ctx_t *dev_ctx, GError **gerr);
+
+bl_future_t *bl_get_all_primary_future(dev_ctx_t *dev_ctx, char *uuid_str,
+                                       GError **gerr);
+
+bl_future_t *bl_get_included_future(dev_ctx_t *dev_ctx,
+                                    bl_primary_t *bl_primary, GError **gerr);
+
+bl_future_t *bl_get_all_char_future(dev_ctx_t *dev_ctx, char *uuid_str,
+                                    bl_primary_t *bl_primary, GError **gerr);
+
+bl_future_t *bl_get_all_desc_by_char_future(dev_ctx_t *dev_ctx,
+                                            bl_char_t *start_bl_char,
+                                            bl_char_t *end_bl_char,
+                                            bl_primary_t *bl_primary,
+                                            GError **gerr);
+
+bl_future_t *bl_read_char_all_future(dev_ctx_t *dev_ctx, char *uuid_str,
+                                     bl_primary_t *bl_primary, GError **gerr);
+
+bl_future_t *bl_read_char_by_char_future(dev_ctx_t *dev_ctx,
+                                         bl_char_t *bl_char, GError **gerr);
+
+bl_future_t *bl_read_desc_by_desc_future(dev_ctx_t *dev_ctx,
+                                         bl_desc_t *bl_desc, GError **gerr);
+
+bl_future_t *bl_read_long_future(dev_ctx_t *dev_ctx, bl_char_t *bl_char,
+                                 bl_chunk_cb_t *chunk, void *user_data,
+                                 GError **gerr);
+
+bl_future_t *bl_read_multi_future(dev_ctx_t *dev_ctx, uint16_t *handles,
+                                  size_t *sizes, int nb, GError **gerr);
+
+bl_future_t *bl_write_char_by_char_future(dev_ctx_t *dev_ctx,
+                                          bl_char_t *bl_char, uint8_t *value,
+                                          size_t size, write_type_t type,
+                                          GError **gerr);
+
+bl_future_t *bl_write_stream_future(dev_ctx_t *dev_ctx, bl_char_t *bl_char,
+                                    bl_write_src_t *src, void *src_data,
+                                    int window, bl_progress_cb_t *progress,
+                                    void *progress_data, GError **gerr);
+
+bl_future_t *bl_write_file_future(dev_ctx_t *dev_ctx, bl_char_t *bl_char,
+                                  const char *path, size_t offset,
+                                  int window, bl_progress_cb_t *progress,
+                                  void *progress_data, GError **gerr);
+
+bl_future_t *bl_write_desc_by_desc_future(dev_ctx_t *dev_ctx,
+                                          bl_desc_t *bl_desc, uint8_t *value,
+                                          size_t size, GError **gerr);
+
+bl_future_t *bl_change_mtu_future(dev_ctx_t *dev_ctx, int value,
+                                  GError **gerr);
+
+// Request id of the future, the same one bl_*_async would have returned.
+unsigned int bl_future_get_id(bl_future_t *future);
+
+// Returns TRUE if the request is completed, never blocks.
+gboolean bl_future_poll(bl_future_t *future);
+
+// Wait for a request to complete. timeout_ms < 0 waits forever.
+// Returns FALSE on timeout or if the event loop stopped.
+gboolean bl_future_wait(bl_future_t *future, int timeout_ms);
+
+// Wait for any of the nb futures to complete and return its index, -1 on
+// timeout or if the event loop stopped. NULL futures are ignored.
+int bl_future_wait_any(bl_future_t **futures, int nb, int timeout_ms);
+
+// Wait for all the nb futures to complete. Returns FALSE on timeout or if the
+// event loop stopped. NULL futures are ignored.
+gboolean bl_future_wait_all(bl_future_t **futures, int nb, int timeout_ms);
+
+// Take the results of a completed request: result gets what the blocking
+// function would have returned (may be NULL), you have to free it.
+// Returns the error code of the request and sets gerr accordingly, or
+// BL_PENDING_ERROR if it is not completed yet.
+int bl_future_get_result(bl_future_t *future, void **result, GError **gerr);
+
+// Change the deadline of a pending request, counted from now. 0 removes it.
+// Returns FALSE if the request was already completed.
+gboolean bl_future_set_timeout(bl_future_t *future, int timeout_ms);
+
+// Same as bl_cancel.
+// Returns FALSE if the request was already completed.
+gboolean bl_future_cancel(bl_future_t *future);
+
+// Release a future. A pending request is not cancelled, its results are
+// dropped when they arrive.
+void bl_future_free(bl_future_t *future);
+
+
 /****************************** Notifications *******************************
  * NOTE: The notification list is part of the variable "attrib" which is
  * allocated at each connection. And free at each deconnection. Even not
@@ -351,6 +739,9 @@ int bl_change_mtu(dev_ctx_t *dev_ctx, int value);
  * Opcodes:
  *  ATT_OP_HANDLE_NOTIFY for a notification
  *  ATT_OP_HANDLE_IND    for a indication
+ *
+ * The values of a Multiple Handle Value Notification are given to the
+ * callbacks one by one, as ATT_OP_HANDLE_NOTIFY.
  */
 #define NOTIF_PDU_HEADER_SIZE 3
 
@@ -385,4 +776,107 @@ void bl_notif_list_print(dev_ctx_t *dev_ctx);
 // acknowledge the indication.
 void bl_notif_indication_resp(dev_ctx_t *dev_ctx);
 
+// Acknowledge the indications of the characteristic uuid_str from the event
+// loop as soon as they arrive, before your callback is called: do not call
+// bl_notif_indication_resp anymore. The device can then send the next one
+// without waiting for the callback. Call it once the indication is added.
+int bl_notif_set_auto_confirm(dev_ctx_t *dev_ctx, char *uuid_str,
+                              gboolean enable);
+
+// From the callback, keep the value of the notification past its return.
+// See bl_set_zero_copy, the value is copied when it is disabled. Release it
+// with g_bytes_unref, from any thread. Returns NULL for an invalid PDU.
+GBytes *bl_notif_value_ref(dev_ctx_t *dev_ctx, const uint8_t *pdu,
+                           uint16_t len);
+
+// Let the device send several notifications in a single Multiple Handle
+// Value Notification, in the Client Supported Features. The notifications
+// still have to be added.
+int bl_enable_notif_multi(dev_ctx_t *dev_ctx);
+
+// A value of a Multiple Handle Value Notification, valid during the
+// callback.
+typedef struct {
+    uint16_t       handle;
+    const uint8_t *data;
+    size_t         size;
+} bl_notif_item_t;
+
+typedef void (*bl_notif_batch_cb_t)(dev_ctx_t *dev_ctx,
+                                    const bl_notif_item_t *items, int nb,
+                                    void *user_data);
+
+// Call func with all the values of each Multiple Handle Value Notification,
+// before they are given one by one to the callbacks of their
+// characteristics. Replaces the previous one.
+int bl_add_notif_batch(dev_ctx_t *dev_ctx, bl_notif_batch_cb_t func,
+                       void *user_data);
+
+// Remove the callback of bl_add_notif_batch.
+int bl_remove_notif_batch(dev_ctx_t *dev_ctx);
+
+/*
+ * Notification ring: the event loop only pushes the notifications in a
+ * bounded lock-free ring, drained in batches by a consumer thread. A ring
+ * has a single producer, all its subscriptions must be on devices of the
+ * same event loop (always true for a single device), and a single consumer.
+ * Indications are acknowledged on arrival, see bl_notif_set_auto_confirm.
+ */
+typedef struct {
+    dev_ctx_t  *dev_ctx;   // Device that sent it.
+    uint16_t    handle;
+    gint64      timestamp; // g_get_monotonic_time() at reception.
+    GBytes     *value;     // See bl_notif_value_ref, release it.
+} bl_notif_t;
+
+typedef struct bl_notif_ring bl_notif_ring_t;
+
+// What a subscription does when the ring is full.
+typedef enum {
+    BL_OVERFLOW_DROP_NEWEST, // Drop the notification received.
+    BL_OVERFLOW_DROP_OLDEST, // Drop the oldest one in the ring, of any
+                             // subscription.
+    BL_OVERFLOW_BLOCK,       // Wait for room, blocking the event loop and
+                             // every device on it.
+    BL_OVERFLOW_KEEP_LATEST, // Only keep the newest value: it replaces the
+                             // one not popped yet, full ring or not. If the
+                             // ring is full, it is popped once the ring is
+                             // drained.
+} bl_overflow_t;
+
+// Counters of a subscription.
+typedef struct {
+    unsigned int received;   // Notifications received.
+    unsigned int dropped;    // Dropped, see bl_overflow_t.
+    unsigned int conflated;  // Replaced by a newer value.
+    unsigned int blocked;    // Times the event loop waited for room.
+} bl_notif_stats_t;
+
+// The capacity is rounded up to a power of two.
+bl_notif_ring_t *bl_notif_ring_new(size_t capacity);
+
+// Free the ring and the notifications left in it, once every subscription
+// pushing to it is removed.
+void bl_notif_ring_free(bl_notif_ring_t *ring);
+
+// Same as bl_add_notif_by_char, pushing the notifications to ring. A
+// previous subscription on the characteristic is replaced.
+int bl_add_notif_ring(dev_ctx_t *dev_ctx, bl_char_t *start_bl_char,
+                      bl_char_t *end_bl_char, bl_primary_t *bl_primary,
+                      bl_notif_ring_t *ring, bl_overflow_t policy,
+                      uint8_t opcode);
+
+// Move at most max of the oldest notifications to notifs, returns their
+// number. Never blocks.
+size_t bl_notif_ring_pop(bl_notif_ring_t *ring, bl_notif_t *notifs,
+                         size_t max);
+
+// Number of notifications dropped because the ring was full.
+unsigned int bl_notif_ring_dropped(bl_notif_ring_t *ring);
+
+// Get the counters of the subscription of the ring on the value handle of
+// the device, while it is registered.
+int bl_notif_ring_get_stats(bl_notif_ring_t *ring, dev_ctx_t *dev_ctx,
+                            uint16_t handle, bl_notif_stats_t *stats);
+
 #endif
@@ -56,6 +56,7 @@ typedef struct {
     uint16_t    handle;
     size_t      data_size;
     uint8_t    *data;
+    GBytes     *bytes;     // Holds data when it is not copied, else NULL
 } bl_value_t;
 
 
@@ -77,6 +78,10 @@ bl_desc_t *bl_desc_new(char *uuid_str, const uint16_t handle);
 bl_value_t *bl_value_new(char *uuid_str, const uint16_t handle,
                          const size_t data_size, uint8_t *data);
 
+// Same, the data of bytes is referenced instead of copied.
+bl_value_t *bl_value_new_from_bytes(char *uuid_str, const uint16_t handle,
+                                    GBytes *bytes);
+
 // Struct copy
 bl_primary_t  *bl_primary_cpy  (bl_primary_t  *bl_primary);
 bl_included_t *bl_included_cpy (bl_included_t *bl_included);
@@ -27,28 +27,197 @@
 #include <stdint.h>
 #include "bluelib.h"
 
+typedef struct cb_ctx cb_ctx_t;
+
+// Sends the command of a request on the GAttrib of its device, with the
+// arguments stored in the context. Returns the GAttrib id, 0 on failure.
+typedef guint (cb_send_t)(GAttrib *attrib, cb_ctx_t *cb_ctx);
+
+// Runs on the event loop of a device for run_in_loop, returns an error code.
+typedef int (cb_loop_t)(dev_ctx_t *dev_ctx, void *data);
+
+// Streaming write, see bl_write_stream. The data comes from src, or from
+// the size bytes of data when src is NULL: they are sent without being
+// copied when they belong to file. A buffer of the caller can be released
+// as soon as the request ends, even cancelled with commands still queued,
+// so it is copied in each command.
 typedef struct {
+    bl_write_src_t   *src;
+    void             *src_data;
+    const uint8_t    *data;
+    size_t            size;
+    size_t            pos;
+    GMappedFile      *file;       // Holds data if not NULL.
+    bl_progress_cb_t *progress;
+    void             *progress_data;
+    int               window;     // Commands queued at most.
+    GQueue            chunks;     // Commands queued, oldest first.
+    gboolean          ended;      // Nothing more to send.
+    size_t            written;    // Bytes given to the socket.
+    gint64            start_time;
+} write_stream_t;
+
+struct cb_ctx {
     dev_ctx_t *dev_ctx;
+    int        refs;
+    unsigned   req_id;
     GMutex     pending_cb_mtx;
+    GCond      pending_cb_cond; // Signaled by the callback on completion.
+    gboolean   cb_done;
     uint16_t   end_handle_cb; // Used in only some callbacks.
+    uint16_t   handle_cb;     // Handle of the request, set in the results.
+    char       uuid_cb[MAX_LEN_UUID_STR]; // UUID of the request, set in the
+                                          // results if not empty.
+
+    // Request waiting in the queue of its device, see submit_cb.
+    cb_send_t *send_cb;
+    uint16_t   start_handle_cb;
+    bt_uuid_t *uuid_req;      // Points to uuid_buf or NULL.
+    bt_uuid_t  uuid_buf;
+    uint8_t   *value_cb;      // Copy of the value to write.
+    size_t     value_size_cb;
+
+    // Results gathered over the responses of a multi-part request, in
+    // reverse order. Freed with the context if the request does not end.
+    GSList        *list_cb;
+    GDestroyNotify list_cb_free; // list_free by default.
+    int            nb_pdu_cb;    // Responses received so far.
+
+    // Given the results of each response as they arrive instead of
+    // gathering them, see bl_read_char_all_stream.
+    bl_stream_cb_t *stream_cb;
+
+    // Read Multiple: the handles, the size of their values (NULL for
+    // variable length), the first one of the PDU sent and their number.
+    // alone_cb when the value at pos_cb does not fit in a response: it is
+    // read on its own, with Read Blob Requests if needed.
+    uint16_t  *handles_cb;
+    uint16_t  *sizes_cb;
+    int        nb_handles_cb;
+    int        pos_cb;
+    int        batch_cb;
+    gboolean   alone_cb;
+
+    // Long read: the value is given to chunk_cb part by part, or copied in
+    // buf_cb of buf_size_cb bytes. offset_cb is the size read so far.
+    bl_chunk_cb_t *chunk_cb;
+    uint8_t       *buf_cb;
+    size_t         buf_size_cb;
+    size_t         offset_cb;
+
+    // Streaming write, NULL for the other requests.
+    write_stream_t *wstream_cb;
+
+    // Completion function of the asynchronous requests, NULL if a thread is
+    // waiting for the results with wait_for_cb.
+    bl_req_cb_t *async_cb;
+    void        *async_user_data;
 
     // Return value from the callback functions
-    void      *cb_ret_pointer;
-    int        cb_ret_val;
-    char       cb_ret_msg[1024];
-} cb_ctx_t;
+    void          *cb_ret_pointer;
+    GDestroyNotify cb_ret_free; // Frees cb_ret_pointer if nobody took it.
+    int            cb_ret_val;
+    char           cb_ret_msg[1024];
+
+    // Set when the request is completed without waiting for its callback
+    // (cancelled), overrides the return values above.
+    int         cb_abort_val;
+    const char *cb_abort_msg;
+
+    // Deadline of the request, see set_cb_timeout.
+    GSource    *timeout_source;
+
+    // Id of the GAttrib command currently sent for the request, 0 if none.
+    guint       attrib_id;
+    // The callback is the GDestroyNotify of the command, it is called even
+    // if the command is cancelled.
+    gboolean    cb_in_notify;
+    // Connection request: the link is closed if its deadline expires.
+    gboolean    link_cb;
+};
 
-// Initializes the structure you must give to every callback in user_data
-void init_cb_ctx(cb_ctx_t *cb_ctx, dev_ctx_t *dev_ctx);
+// Allocates the structure you must give to every callback in user_data.
+// If func is NULL, the results are retrieved with wait_for_cb, otherwise func
+// is called from the event loop thread on completion.
+cb_ctx_t *cb_ctx_new(dev_ctx_t *dev_ctx, bl_req_cb_t *func, void *user_data);
+cb_ctx_t *cb_ctx_ref(cb_ctx_t *cb_ctx);
+void      cb_ctx_unref(cb_ctx_t *cb_ctx);
 
 // Event loop
-int  start_event_loop(GError **gerr);
+// nb_loops threads are started, each one running its own event loop.
+int  start_event_loop(int nb_loops, GError **gerr);
+// Use the event loop of the application instead of starting our own.
+int  attach_event_context(GMainContext *context, GError **gerr);
 void stop_event_loop(void);
 int  is_event_loop_running(void);
+int  get_nb_event_loops(void);
+
+// Choose the context every source of the device must be attached to, NULL
+// for the default one. With several event loops, the device goes to the one
+// given by its affinity, or else by the hash of its address. Called when the
+// device is initialised or its affinity changes, get_event_context returns
+// it afterwards.
+void          resolve_event_context(dev_ctx_t *dev_ctx);
+GMainContext *get_event_context(dev_ctx_t *dev_ctx);
+
+// Returns TRUE if the calling thread can run the event loop itself, i.e. it
+// is the thread of the application event loop. Release the context with
+// g_main_context_release once done.
+gboolean acquire_event_context(GMainContext *context);
 
 // Block the main thread while waiting for the callback
 int wait_for_cb(cb_ctx_t *cb_ctx, void **ret_pointer, GError **gerr);
 
+// Called by every callback once the results are set, wakes up wait_for_cb or
+// calls the asynchronous completion function. Releases the reference that
+// was taken for the callback when the request was sent.
+void signal_cb(cb_ctx_t *cb_ctx);
+
+// Queue a request on its device, it is sent with send from the event loop of
+// the device, which is the only thread using the GAttrib. Any thread can
+// submit requests, they are sent in order and each response goes to the
+// context of its command. The request is tracked and its deadline started
+// right away. If it cannot be sent, it is completed with
+// BL_SEND_REQUEST_ERROR.
+void submit_cb(cb_ctx_t *cb_ctx, cb_send_t *send);
+
+// Call func from the event loop of the device and wait for its return
+// value, for what uses the GAttrib without being a request. func runs right
+// away if the calling thread owns the event loop, or if none is running.
+int run_in_loop(dev_ctx_t *dev_ctx, cb_loop_t *func, void *data);
+
+// Complete a request before its callback is called, with the error code val.
+// The results of the callback will be dropped. Returns FALSE if the request
+// was already completed. The completion function is called right away: call
+// it from the event loop of the device, else use cancel_cb.
+gboolean abort_cb(cb_ctx_t *cb_ctx, int val, const char *msg);
+
+// (Re)start the deadline of a sent request, it is aborted with
+// BL_TIMEOUT_ERROR after timeout_ms. 0 removes the deadline.
+// Returns FALSE if the request is already completed.
+gboolean set_cb_timeout(cb_ctx_t *cb_ctx, int timeout_ms);
+
+// Register a sent request as pending on its device, attrib_id is the id
+// returned by g_attrib_send. Use set_cb_attrib_id when the callback sends
+// the following command of the request.
+void track_cb(cb_ctx_t *cb_ctx, guint attrib_id);
+void set_cb_attrib_id(cb_ctx_t *cb_ctx, guint attrib_id);
+
+// Complete a pending request with the error code val and remove it from the
+// GAttrib queue from the event loop, where its completion function is
+// called. Returns FALSE if it was already completed.
+gboolean cancel_cb(cb_ctx_t *cb_ctx, int val, const char *msg);
+
+// Same for a request given by its id, returns EINVAL if it is not pending.
+int cancel_req(dev_ctx_t *dev_ctx, unsigned int req_id, int val,
+               const char *msg);
+
+// Same for every pending requests of the device. With now set, the GAttrib
+// queue is cleaned up right away, before destroying the GAttrib: it must
+// then be called from the event loop of the device.
+void cancel_all_req(dev_ctx_t *dev_ctx, int val, const char *msg,
+                    gboolean now);
+
 // Callbacks
 void connect_cb(GIOChannel *io, GError *err, gpointer user_data);
 void primary_all_cb(GSList *services, guint8 status,
@@ -62,10 +231,22 @@ void char_desc_cb(guint8 status, const guint8 *pdu, guint16 plen,
                   gpointer user_data);
 void read_by_hnd_cb(guint8 status, const guint8 *pdu, guint16 plen,
                     gpointer user_data);
+void read_multi_cb(guint8 status, const guint8 *pdu, guint16 plen,
+                   gpointer user_data);
 void read_by_uuid_cb(guint8 status, const guint8 *pdu,
                      guint16 plen, gpointer user_data);
+void read_long_cb(guint8 status, const guint8 *pdu, guint16 plen,
+                  gpointer user_data);
 void write_req_cb(guint8 status, const guint8 *pdu, guint16 plen,
                   gpointer user_data);
 void exchange_mtu_cb(guint8 status, const guint8 *pdu, guint16 plen,
                      gpointer user_data);
+void write_cmd_cb(gpointer user_data);
+
+void write_stream_free(write_stream_t *ws);
+
+// Send function of the streaming writes: queues commands until the window
+// is full or the source is exhausted, the next ones are queued as they are
+// sent. Returns the GAttrib id of the last one, 0 if none was queued.
+guint write_stream_send(GAttrib *attrib, cb_ctx_t *cb_ctx);
 #endif
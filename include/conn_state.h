@@ -30,4 +30,8 @@
 
 void set_conn_state(dev_ctx_t *dev_ctx, conn_state_t state);
 
+// Close the link and fail its pending requests. Must be called from the
+// thread using the GAttrib.
+void disconnect_io(dev_ctx_t *dev_ctx);
+
 #endif
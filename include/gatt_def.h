@@ -39,6 +39,7 @@
 #define GATT_CHARAC_RECONNECTION_ADDRESS_STR  "2A03"
 #define GATT_CHARAC_PERIPHERAL_PREF_CONN_STR  "2A04"
 #define GATT_CHARAC_SERVICE_CHANGED_STR       "2A05"
+#define GATT_CHARAC_CLIENT_SUPP_FEAT_STR      "2B29"
 
 /* GATT Characteristic Descriptors */
 #define GATT_CHARAC_EXT_PROPER_UUID_STR       "2900"
@@ -55,4 +56,7 @@
 #define GATT_CLIENT_CHARAC_CFG_NOTIF_BIT      0x0001
 #define GATT_CLIENT_CHARAC_CFG_IND_BIT        0x0002
 
+/* Client Supported Features bit field, first octet */
+#define GATT_CLIENT_SUPP_FEAT_MULTI_NOTIF_BIT 0x04
+
 #endif
@@ -38,18 +38,23 @@
 
 #define printf(...) printf("[BL] " __VA_ARGS__)
 
-/************************** BlueLib Global Context *************************/
-static GMutex ble_dev_mtx;
-
 /********************************* Helpers *********************************/
-static void disconnect_io(dev_ctx_t *dev_ctx)
+void disconnect_io(dev_ctx_t *dev_ctx)
 {
+    GAttrib *attrib;
+
     if (STATE_DISCONNECTED == get_conn_state(dev_ctx))
         return;
 
-    g_attrib_unref(dev_ctx->attrib);
+    // No response will come for the pending requests
+    cancel_all_req(dev_ctx, BL_DISCONNECTED_ERROR, "Disconnected\n", TRUE);
+
+    g_mutex_lock(&dev_ctx->mtx);
+    attrib = dev_ctx->attrib;
     dev_ctx->attrib = NULL;
     dev_ctx->opt_mtu = 0;
+    g_mutex_unlock(&dev_ctx->mtx);
+    g_attrib_unref(attrib);
 
     g_io_channel_shutdown(dev_ctx->iochannel, FALSE, NULL);
     g_io_channel_unref(dev_ctx->iochannel);
@@ -158,13 +163,84 @@ static inline int handle_assert(uint16_t *start_handle, uint16_t *end_handle,
     }                                                                       \
 }
 
+#define NEW_CB_CTX                                                          \
+{                                                                           \
+    cb_ctx = cb_ctx_new(dev_ctx, func, user_data);                          \
+    if (cb_ctx == NULL) {                                                   \
+        GError *err = g_error_new(BL_ERROR_DOMAIN, BL_MALLOC_ERROR,         \
+                                  "Malloc error\n");                        \
+        PROPAGATE_ERROR;                                                    \
+        goto exit;                                                          \
+    }                                                                       \
+}
+
+/***************************** Request helpers *****************************/
+// Every request is started by a *_start function which returns its context,
+// or NULL with gerr set on failure. The arguments are stored in the context
+// and the request is submitted to its device, the command is sent by the
+// matching *_send function from the event loop. The callback holds its own
+// reference on the context until it is called. The blocking functions wait
+// for the results, the asynchronous ones only return the request id and the
+// futures are the context itself.
+
+// Wait for the results of a started request and release it.
+static void *wait_request(cb_ctx_t *cb_ctx, GError **gerr)
+{
+    void *ret = NULL;
+
+    if (cb_ctx) {
+        wait_for_cb(cb_ctx, &ret, gerr);
+        cb_ctx_unref(cb_ctx);
+    }
+    return ret;
+}
+
+// Same for the requests which only return an error code.
+static int wait_request_ret(cb_ctx_t *cb_ctx, GError *gerr)
+{
+    int ret;
+
+    if (cb_ctx == NULL) {
+        printf("Error: %s", gerr->message);
+        ret = gerr->code;
+        g_error_free(gerr);
+        return ret;
+    }
+
+    ret = wait_for_cb(cb_ctx, NULL, NULL);
+    cb_ctx_unref(cb_ctx);
+    return ret;
+}
+
+// Leave a started request to its completion function.
+static unsigned int async_request(cb_ctx_t *cb_ctx)
+{
+    unsigned int req_id;
+
+    if (cb_ctx == NULL)
+        return 0;
+
+    req_id = cb_ctx->req_id;
+    cb_ctx_unref(cb_ctx);
+    return req_id;
+}
+
 /***************************** Global functions ****************************/
 
 /************************* Initialisation functions ************************/
 int bl_init(GError **gerr)
 {
-    g_mutex_init(&ble_dev_mtx);
-    return start_event_loop(gerr);
+    return start_event_loop(1, gerr);
+}
+
+int bl_init_pool(int nb_loops, GError **gerr)
+{
+    return start_event_loop(nb_loops, gerr);
+}
+
+int bl_init_with_context(GMainContext *context, GError **gerr)
+{
+    return attach_event_context(context, gerr);
 }
 
 void bl_stop(void)
@@ -178,6 +254,11 @@ int dev_init(dev_ctx_t *dev_ctx, char *mac_src, char *mac_dst,
     int ret = BL_NO_ERROR;
 
     BLUELIB_ENTER;
+    g_mutex_init(&dev_ctx->mtx);
+    g_queue_init(&dev_ctx->req_queue);
+    dev_ctx->req_scheduled = FALSE;
+    if (dev_ctx->pending_reqs == NULL)
+        dev_ctx->pending_reqs = g_hash_table_new(NULL, NULL);
     if (mac_src) {
         g_free(dev_ctx->opt_mac_src);
         dev_ctx->opt_mac_src = g_strdup(mac_src);
@@ -193,6 +274,10 @@ int dev_init(dev_ctx_t *dev_ctx, char *mac_src, char *mac_dst,
     }
 
     dev_ctx->opt_psm = psm;
+    dev_ctx->opt_timeout_ms = BL_DEFAULT_TIMEOUT_MS;
+    dev_ctx->opt_loop = -1;
+    dev_ctx->opt_auto_mtu = 0;
+    dev_ctx->opt_zero_copy = FALSE;
 
     if (!mac_dst) {
         printf("Error: Remote Bluetooth address required\n");
@@ -230,85 +315,110 @@ wrongmac:
 error:
     ret = EINVAL;
 exit:
+    resolve_event_context(dev_ctx);
     return ret;
 }
 
 
 
 /******************** Connect/Disconnect from a device *********************/
-// Connect to a device
-int bl_connect(dev_ctx_t *dev_ctx)
+static cb_ctx_t *connect_start(dev_ctx_t *dev_ctx, bl_req_cb_t *func,
+                               void *user_data, GError **gerr)
 {
-    GError  *gerr = NULL;
-    int      ret;
-    cb_ctx_t cb_ctx;
+    cb_ctx_t *cb_ctx = NULL;
+    GError   *err    = NULL;
 
-    BLUELIB_ENTER;
+    BLUELIB_ENTER_GERR;
 
-    init_cb_ctx(&cb_ctx, dev_ctx);
+    if (!is_event_loop_running()) {
+        err = g_error_new(BL_ERROR_DOMAIN, BL_NOT_INIT_ERROR,
+                          "BlueLib not initialised\n");
+        PROPAGATE_ERROR;
+        goto exit;
+    }
 
     if (get_conn_state(dev_ctx) != STATE_DISCONNECTED) {
-        printf("Error: Already connected to a device\n");
-        ret = BL_ALREADY_CONNECTED_ERROR;
-        goto error;
+        err = g_error_new(BL_ERROR_DOMAIN, BL_ALREADY_CONNECTED_ERROR,
+                          "Already connected to a device\n");
+        PROPAGATE_ERROR;
+        goto exit;
     }
 
+    NEW_CB_CTX;
+
     printf("Attempting to connect to %s\n", dev_ctx->opt_mac_dst);
     set_conn_state(dev_ctx, STATE_CONNECTING);
-    g_mutex_lock(&ble_dev_mtx);
+    g_mutex_lock(&dev_ctx->mtx);
     dev_ctx->iochannel = gatt_connect(dev_ctx->opt_mac_src,
                                       dev_ctx->opt_mac_dst,
                                       dev_ctx->opt_mac_dst_type,
                                       dev_ctx->opt_sec_level,
                                       dev_ctx->opt_psm, dev_ctx->opt_mtu,
-                                      connect_cb, &cb_ctx, &gerr);
-    g_mutex_unlock(&ble_dev_mtx);
+                                      get_event_context(dev_ctx),
+                                      connect_cb, cb_ctx_ref(cb_ctx), &err);
+    g_mutex_unlock(&dev_ctx->mtx);
 
-    if (gerr) {
-        printf("Error <%d %s>\n", gerr->code, gerr->message);
+    if (err || !dev_ctx->iochannel) {
         set_conn_state(dev_ctx, STATE_DISCONNECTED);
-        ret = gerr->code;
-        g_error_free(gerr);
-        goto error;
+        if (!err)
+            err = g_error_new(BL_ERROR_DOMAIN, BL_SEND_REQUEST_ERROR,
+                              "iochannel NULL\n");
+        PROPAGATE_ERROR;
+        cb_ctx_unref(cb_ctx);
+        cb_ctx_unref(cb_ctx);
+        return NULL;
     }
 
-    if (!dev_ctx->iochannel) {
-        printf("Error: iochannel NULL\n");
-        set_conn_state(dev_ctx, STATE_DISCONNECTED);
-        ret = BL_SEND_REQUEST_ERROR;
-        goto error;
-    }
+    GSource *source = g_io_create_watch(dev_ctx->iochannel, G_IO_HUP);
+    g_source_set_callback(source, (GSourceFunc) channel_watcher, dev_ctx,
+                          NULL);
+    g_source_attach(source, get_event_context(dev_ctx));
+    g_source_unref(source);
+    track_cb(cb_ctx, 0);
+    // Do not wait for the L2CAP timeout, the link is closed on expiry.
+    cb_ctx->link_cb = TRUE;
+    set_cb_timeout(cb_ctx, dev_ctx->opt_timeout_ms);
+exit:
+    return cb_ctx;
+}
+
+// Connect to a device
+int bl_connect(dev_ctx_t *dev_ctx)
+{
+    GError *gerr = NULL;
+    int     ret;
 
-    g_io_add_watch(dev_ctx->iochannel, G_IO_HUP, channel_watcher, dev_ctx);
+    BLUELIB_ENTER;
 
-    ret = wait_for_cb(&cb_ctx, NULL, NULL);
+    ret = wait_request_ret(connect_start(dev_ctx, NULL, NULL, &gerr), gerr);
+    // Each failure leaves the device disconnected, the link is closed from
+    // the event loop if it was up.
     if (ret) {
         printf("Error: CallBack error\n");
-        set_conn_state(dev_ctx, STATE_DISCONNECTED);
-        goto error;
+        return ret;
     }
 
-    ret = BL_NO_ERROR;
     if (dev_ctx->connect_cb_fct)
         return dev_ctx->connect_cb_fct();
-    return ret;
+    return BL_NO_ERROR;
+}
 
-error:
-    return ret;;
+static int disconnect_loop(dev_ctx_t *dev_ctx, void *data)
+{
+    disconnect_io(dev_ctx);
+    return BL_NO_ERROR;
 }
 
 // Disconnect from the device, delete the nofication list.
 int bl_disconnect(dev_ctx_t *dev_ctx)
 {
     int ret = BL_NO_ERROR;
-    cb_ctx_t cb_ctx;
 
     BLUELIB_ENTER;
 
-    init_cb_ctx(&cb_ctx, dev_ctx);
-
+    // The GAttrib is torn down from its event loop.
     if (get_conn_state(dev_ctx) != STATE_DISCONNECTED)
-        disconnect_io(dev_ctx);
+        ret = run_in_loop(dev_ctx, disconnect_loop, NULL);
     printf("Disconnected\n");
     return ret;;
 }
@@ -323,53 +433,98 @@ int bl_set_connect_cb(dev_ctx_t *dev_ctx, user_cb_fct_t func)
 }
 
 
+int bl_set_request_timeout(dev_ctx_t *dev_ctx, int timeout_ms)
+{
+    if (dev_ctx == NULL)
+        return BL_NO_CTX_ERROR;
+
+    if (timeout_ms < 0)
+        return EINVAL;
+
+    dev_ctx->opt_timeout_ms = timeout_ms;
+    return BL_NO_ERROR;
+}
+
+int bl_set_auto_mtu(dev_ctx_t *dev_ctx, int mtu)
+{
+    if (dev_ctx == NULL)
+        return BL_NO_CTX_ERROR;
+
+    if (dev_ctx->opt_psm)
+        return BL_LE_ONLY_ERROR;
+
+    if (mtu && ((mtu < ATT_DEFAULT_LE_MTU) || (mtu > BL_MAX_MTU)))
+        return EINVAL;
+
+    dev_ctx->opt_auto_mtu = mtu;
+    return BL_NO_ERROR;
+}
+
+int bl_set_zero_copy(dev_ctx_t *dev_ctx, gboolean enable)
+{
+    if (dev_ctx == NULL)
+        return BL_NO_CTX_ERROR;
+
+    dev_ctx->opt_zero_copy = enable;
+    return BL_NO_ERROR;
+}
+
+int bl_set_loop_affinity(dev_ctx_t *dev_ctx, int loop)
+{
+    if (dev_ctx == NULL)
+        return BL_NO_CTX_ERROR;
+
+    if (get_conn_state(dev_ctx) != STATE_DISCONNECTED)
+        return BL_ALREADY_CONNECTED_ERROR;
+
+    if ((loop < -1) || (loop >= get_nb_event_loops()))
+        return EINVAL;
+
+    dev_ctx->opt_loop = loop;
+    resolve_event_context(dev_ctx);
+    return BL_NO_ERROR;
+}
+
+
 /************************* Primary Service Discovery ***********************/
-// Get all the primary service associated of an UUID.
-// Return a list of primary services (bl_primary_t *).
-GSList *bl_get_all_primary(dev_ctx_t *dev_ctx, char *uuid_str, GError **gerr)
+static guint get_all_primary_send(GAttrib *attrib, cb_ctx_t *cb_ctx)
 {
-    GSList *ret = NULL;
-    cb_ctx_t cb_ctx;
+    if (cb_ctx->uuid_req)
+        return gatt_discover_primary(attrib, cb_ctx->uuid_req,
+                                     primary_by_uuid_cb, cb_ctx);
+    return gatt_discover_primary(attrib, NULL, primary_all_cb, cb_ctx);
+}
+
+static cb_ctx_t *get_all_primary_start(dev_ctx_t *dev_ctx, char *uuid_str,
+                                       bl_req_cb_t *func, void *user_data,
+                                       GError **gerr)
+{
+    cb_ctx_t *cb_ctx = NULL;
 
-    CLEAR_GERROR;
     BLUELIB_ENTER_GERR;
     ASSERT_CONNECTED_GERR;
+    NEW_CB_CTX;
 
-    init_cb_ctx(&cb_ctx, dev_ctx);
-
-    g_mutex_lock(&ble_dev_mtx);
     if (uuid_str) {
-        bt_uuid_t uuid;
-        bt_string_to_uuid(&uuid, uuid_str);
-
-        if (!gatt_discover_primary(dev_ctx->attrib, &uuid, primary_by_uuid_cb,
-                                   &cb_ctx)) {
-            GError *err = g_error_new(BL_ERROR_DOMAIN, BL_SEND_REQUEST_ERROR,
-                                      "Unable to send request\n");
-            PROPAGATE_ERROR;
-            g_mutex_unlock(&ble_dev_mtx);
-            goto exit;
-        }
-
-    } else if (!gatt_discover_primary(dev_ctx->attrib, NULL, primary_all_cb,
-                                      &cb_ctx)) {
-        GError *err = g_error_new(BL_ERROR_DOMAIN, BL_SEND_REQUEST_ERROR,
-                                  "Unable to send request\n");
-        PROPAGATE_ERROR;
-        g_mutex_unlock(&ble_dev_mtx);
-        goto exit;
-    }
-    g_mutex_unlock(&ble_dev_mtx);
+        bt_string_to_uuid(&cb_ctx->uuid_buf, uuid_str);
+        cb_ctx->uuid_req = &cb_ctx->uuid_buf;
 
-    if (wait_for_cb(&cb_ctx, (void **) &ret, gerr))
-        goto exit;
-    if ((ret != NULL) && (uuid_str)) {
         // Add uuid to each bl_primary of the list
-        for (GSList *l = ret; l; l = l->next)
-            strcpy(((bl_primary_t *)(l->data))->uuid_str, uuid_str);
+        strncpy(cb_ctx->uuid_cb, uuid_str, MAX_LEN_UUID_STR - 1);
     }
+
+    submit_cb(cb_ctx, get_all_primary_send);
 exit:
-    return ret;;
+    return cb_ctx;
+}
+
+// Get all the primary service associated of an UUID.
+// Return a list of primary services (bl_primary_t *).
+GSList *bl_get_all_primary(dev_ctx_t *dev_ctx, char *uuid_str, GError **gerr)
+{
+    CLEAR_GERROR;
+    return wait_request(get_all_primary_start(dev_ctx, uuid_str, NULL, NULL,
+                                              gerr), gerr);
 }
 
 // Get a specific primary service.
@@ -408,20 +563,22 @@ GSList *bl_get_all_primary_device(dev_ctx_t *dev_ctx, GError **gerr)
 
 
 /************************** Get Included Services **************************/
-// Get all the included service of a primary service.
-// Returns a list of included services (bl_included_t *).
-GSList *bl_get_included(dev_ctx_t *dev_ctx, bl_primary_t *bl_primary,
-                        GError **gerr)
+static guint get_included_send(GAttrib *attrib, cb_ctx_t *cb_ctx)
 {
-    GSList *ret = NULL;
-    cb_ctx_t cb_ctx;
+    return gatt_find_included(attrib, cb_ctx->start_handle_cb,
+                              cb_ctx->end_handle_cb, included_cb, cb_ctx);
+}
+
+static cb_ctx_t *get_included_start(dev_ctx_t *dev_ctx,
+                                    bl_primary_t *bl_primary,
+                                    bl_req_cb_t *func, void *user_data,
+                                    GError **gerr)
+{
+    cb_ctx_t *cb_ctx = NULL;
 
-    CLEAR_GERROR;
     BLUELIB_ENTER_GERR;
     ASSERT_CONNECTED_GERR;
 
-    init_cb_ctx(&cb_ctx, dev_ctx);
-
     // Initialisation to default range.
     uint16_t start_handle = 0x0001;
     uint16_t end_handle   = 0xffff;
@@ -429,40 +586,44 @@ GSList *bl_get_included(dev_ctx_t *dev_ctx, bl_primary_t *bl_primary,
     if (handle_assert(&start_handle, &end_handle, bl_primary, gerr))
         goto exit;
 
-    g_mutex_lock(&ble_dev_mtx);
-    if (!gatt_find_included(dev_ctx->attrib, start_handle,
-                            end_handle, included_cb,
-                            &cb_ctx))
-    {
-        GError *err = g_error_new(BL_ERROR_DOMAIN, BL_SEND_REQUEST_ERROR,
-                                  "Unable to send request\n");
-        PROPAGATE_ERROR;
-        g_mutex_unlock(&ble_dev_mtx);
-        goto exit;
-    }
-    g_mutex_unlock(&ble_dev_mtx);
+    NEW_CB_CTX;
+    cb_ctx->start_handle_cb = start_handle;
+    cb_ctx->end_handle_cb   = end_handle;
 
-    wait_for_cb(&cb_ctx, (void **) &ret, gerr);
+    submit_cb(cb_ctx, get_included_send);
 exit:
-    return ret;;
+    return cb_ctx;
+}
+
+// Get all the included service of a primary service.
+// Returns a list of included services (bl_included_t *).
+GSList *bl_get_included(dev_ctx_t *dev_ctx, bl_primary_t *bl_primary,
+                        GError **gerr)
+{
+    CLEAR_GERROR;
+    return wait_request(get_included_start(dev_ctx, bl_primary, NULL, NULL,
+                                           gerr), gerr);
 }
 
 
 /*************************** Get characteristics ***************************/
-// Get all characteristics associated to an UUID on a primary service.
-// Returns a list of characteristics (bl_char_t *) associated to the UUID
-GSList *bl_get_all_char(dev_ctx_t *dev_ctx, char *uuid_str,
-                        bl_primary_t *bl_primary, GError **gerr)
+static guint get_all_char_send(GAttrib *attrib, cb_ctx_t *cb_ctx)
 {
-    GSList *ret = NULL;
-    cb_ctx_t cb_ctx;
+    return gatt_discover_char(attrib, cb_ctx->start_handle_cb,
+                              cb_ctx->end_handle_cb, cb_ctx->uuid_req,
+                              char_by_uuid_cb, cb_ctx);
+}
+
+static cb_ctx_t *get_all_char_start(dev_ctx_t *dev_ctx, char *uuid_str,
+                                    bl_primary_t *bl_primary,
+                                    bl_req_cb_t *func, void *user_data,
+                                    GError **gerr)
+{
+    cb_ctx_t  *cb_ctx = NULL;
 
-    CLEAR_GERROR;
     BLUELIB_ENTER_GERR;
     ASSERT_CONNECTED_GERR;
 
-    init_cb_ctx(&cb_ctx, dev_ctx);
-
     // Intialisation to default range.
     uint16_t start_handle;
     uint16_t end_handle;
@@ -470,28 +631,27 @@ GSList *bl_get_all_char(dev_ctx_t *dev_ctx, char *uuid_str,
     if (handle_assert(&start_handle, &end_handle, bl_primary, gerr))
         goto exit;
 
-    bt_uuid_t *puuid = NULL;
-
+    NEW_CB_CTX;
+    cb_ctx->start_handle_cb = start_handle;
+    cb_ctx->end_handle_cb   = end_handle;
     if (uuid_str) {
-        bt_uuid_t uuid;
-        bt_string_to_uuid(&uuid, uuid_str);
-        puuid = &uuid;
-    }
-
-    g_mutex_lock(&ble_dev_mtx);
-    if (!gatt_discover_char(dev_ctx->attrib, start_handle, end_handle, puuid,
-                            char_by_uuid_cb, &cb_ctx)) {
-        GError *err = g_error_new(BL_ERROR_DOMAIN, BL_SEND_REQUEST_ERROR,
-                                  "Unable to send request\n");
-        PROPAGATE_ERROR;
-        g_mutex_unlock(&ble_dev_mtx);
-        goto exit;
+        bt_string_to_uuid(&cb_ctx->uuid_buf, uuid_str);
+        cb_ctx->uuid_req = &cb_ctx->uuid_buf;
     }
-    g_mutex_unlock(&ble_dev_mtx);
 
-    wait_for_cb(&cb_ctx, (void **) &ret, gerr);
+    submit_cb(cb_ctx, get_all_char_send);
 exit:
-    return ret;;
+    return cb_ctx;
+}
+
+// Get all characteristics associated to an UUID on a primary service.
+// Returns a list of characteristics (bl_char_t *) associated to the UUID
+GSList *bl_get_all_char(dev_ctx_t *dev_ctx, char *uuid_str,
+                        bl_primary_t *bl_primary, GError **gerr)
+{
+    CLEAR_GERROR;
+    return wait_request(get_all_char_start(dev_ctx, uuid_str, bl_primary,
+                                           NULL, NULL, gerr), gerr);
 }
 
 // Get a specific characteristic associated to an UUID on a primary service.
@@ -532,29 +692,28 @@ GSList *bl_get_all_char_in_primary(dev_ctx_t *dev_ctx,
 
 
 /****************************** Get Descriptors ****************************/
-// Get all the descriptors of a specified characteristic on a primary
-// service.
-// Setting end_bl_char avoid uneeded packet by specifying the end of the zone
-// to search, but the result is the same with or without.
-// Returns a list of characteristic descriptor (bl_desc_t *).
-GSList *bl_get_all_desc_by_char(dev_ctx_t *dev_ctx, bl_char_t *start_bl_char,
-                                bl_char_t *end_bl_char,
-                                bl_primary_t *bl_primary, GError **gerr)
+static guint get_all_desc_send(GAttrib *attrib, cb_ctx_t *cb_ctx)
+{
+    return gatt_discover_char_desc(attrib, cb_ctx->start_handle_cb,
+                                   cb_ctx->end_handle_cb, char_desc_cb,
+                                   cb_ctx);
+}
+
+static cb_ctx_t *get_all_desc_by_char_start(dev_ctx_t *dev_ctx,
+                                            bl_char_t *start_bl_char,
+                                            bl_char_t *end_bl_char,
+                                            bl_primary_t *bl_primary,
+                                            bl_req_cb_t *func,
+                                            void *user_data, GError **gerr)
 {
-    GSList   *ret = NULL;
+    cb_ctx_t *cb_ctx = NULL;
     uint16_t  start_handle;
     uint16_t  end_handle;
-    cb_ctx_t  cb_ctx;
 
-    CLEAR_GERROR;
     BLUELIB_ENTER_GERR;
     ASSERT_CONNECTED_GERR;
 
-    init_cb_ctx(&cb_ctx, dev_ctx);
-
-    if (start_bl_char) {
-        start_handle = start_bl_char->handle + 1;
-    } else {
+    if (!start_bl_char) {
         GError *err = g_error_new(BL_ERROR_DOMAIN, BL_MISSING_ARGUMENT_ERROR,
                                   "Start characteristic needed\n");
         PROPAGATE_ERROR;
@@ -564,6 +723,8 @@ GSList *bl_get_all_desc_by_char(dev_ctx_t *dev_ctx, bl_char_t *start_bl_char,
     if (handle_assert(&start_handle, &end_handle, bl_primary, gerr))
         goto exit;
 
+    start_handle = start_bl_char->handle + 1;
+
     if (end_bl_char) {
         end_handle = end_bl_char->handle - 1;
     } else
@@ -580,22 +741,28 @@ GSList *bl_get_all_desc_by_char(dev_ctx_t *dev_ctx, bl_char_t *start_bl_char,
         goto exit;
     }
 
-    cb_ctx.end_handle_cb = end_handle;
-
-    g_mutex_lock(&ble_dev_mtx);
-    if (!gatt_discover_char_desc(dev_ctx->attrib, start_handle, end_handle,
-                                 char_desc_cb, &cb_ctx)) {
-        GError *err = g_error_new(BL_ERROR_DOMAIN, BL_SEND_REQUEST_ERROR,
-                                  "Unable to send request\n");
-        PROPAGATE_ERROR;
-        g_mutex_unlock(&ble_dev_mtx);
-        goto exit;
-    }
-    g_mutex_unlock(&ble_dev_mtx);
+    NEW_CB_CTX;
+    cb_ctx->start_handle_cb = start_handle;
+    cb_ctx->end_handle_cb   = end_handle;
 
-    wait_for_cb(&cb_ctx, (void **) &ret, gerr);
+    submit_cb(cb_ctx, get_all_desc_send);
 exit:
-    return ret;;
+    return cb_ctx;
+}
+
+// Get all the descriptors of a specified characteristic on a primary
+// service.
+// Setting end_bl_char avoid uneeded packet by specifying the end of the zone
+// to search, but the result is the same with or without.
+// Returns a list of characteristic descriptor (bl_desc_t *).
+GSList *bl_get_all_desc_by_char(dev_ctx_t *dev_ctx, bl_char_t *start_bl_char,
+                                bl_char_t *end_bl_char,
+                                bl_primary_t *bl_primary, GError **gerr)
+{
+    CLEAR_GERROR;
+    return wait_request(get_all_desc_by_char_start(dev_ctx, start_bl_char,
+                                                   end_bl_char, bl_primary,
+                                                   NULL, NULL, gerr), gerr);
 }
 
 // Get all the descriptors of the unique characteristic associated to the
@@ -690,19 +857,21 @@ bl_desc_t *bl_get_desc(dev_ctx_t *dev_ctx, char *char_uuid_str,
 
 
 /************************* Read characteristic value ***********************/
-// Read by handle.
-static bl_value_t *read_by_hnd(dev_ctx_t *dev_ctx, uint16_t handle,
-                               GError **gerr)
+static guint read_by_hnd_send(GAttrib *attrib, cb_ctx_t *cb_ctx)
 {
-    bl_value_t *ret = NULL;
-    *gerr = NULL;
-    cb_ctx_t cb_ctx;
+    return gatt_read_char(attrib, cb_ctx->handle_cb, read_by_hnd_cb, cb_ctx);
+}
+
+// Read by handle, uuid_str is copied into the value if not NULL.
+static cb_ctx_t *read_by_hnd_start(dev_ctx_t *dev_ctx, uint16_t handle,
+                                   char *uuid_str, bl_req_cb_t *func,
+                                   void *user_data, GError **gerr)
+{
+    cb_ctx_t *cb_ctx = NULL;
 
     BLUELIB_ENTER_GERR;
     ASSERT_CONNECTED_GERR;
 
-    init_cb_ctx(&cb_ctx, dev_ctx);
-
     if (handle == INVALID_HANDLE) {
         GError *err = g_error_new(BL_ERROR_DOMAIN, EINVAL,
                                   "Invalid handle\n");
@@ -710,41 +879,71 @@ static bl_value_t *read_by_hnd(dev_ctx_t *dev_ctx, uint16_t handle,
         goto exit;
     }
 
-    g_mutex_lock(&ble_dev_mtx);
-    if (!gatt_read_char(dev_ctx->attrib, handle, read_by_hnd_cb,
-                        dev_ctx->attrib)) {
-        GError *err = g_error_new(BL_ERROR_DOMAIN, BL_SEND_REQUEST_ERROR,
-                                  "Unable to send request\n");
-        PROPAGATE_ERROR;
-        g_mutex_unlock(&ble_dev_mtx);
-        goto exit;
-    }
-    g_mutex_unlock(&ble_dev_mtx);
+    NEW_CB_CTX;
+    cb_ctx->handle_cb = handle;
+    if (uuid_str)
+        strncpy(cb_ctx->uuid_cb, uuid_str, MAX_LEN_UUID_STR - 1);
+
+    submit_cb(cb_ctx, read_by_hnd_send);
+exit:
+    return cb_ctx;
+}
+
+static bl_value_t *read_by_hnd(dev_ctx_t *dev_ctx, uint16_t handle,
+                               char *uuid_str, GError **gerr)
+{
+    CLEAR_GERROR;
+    return wait_request(read_by_hnd_start(dev_ctx, handle, uuid_str, NULL,
+                                          NULL, gerr), gerr);
+}
 
-    wait_for_cb(&cb_ctx, (void **) &ret, gerr);
+static guint read_char_all_send(GAttrib *attrib, cb_ctx_t *cb_ctx)
+{
+    return gatt_read_char_by_uuid(attrib, cb_ctx->start_handle_cb,
+                                  cb_ctx->end_handle_cb, cb_ctx->uuid_req,
+                                  read_by_uuid_cb, cb_ctx);
+}
 
-    // Add handle to the value
-    if (ret)
-        ret->handle = handle;
+// Every match of the range is read, the callback sends a new request from
+// the handle following the last one returned until the range is exhausted.
+// With stream set, the values of each response go to stream instead of the
+// results.
+static cb_ctx_t *read_by_type_start(dev_ctx_t *dev_ctx, char *uuid_str,
+                                    uint16_t start_handle,
+                                    uint16_t end_handle,
+                                    bl_stream_cb_t *stream,
+                                    bl_req_cb_t *func, void *user_data,
+                                    GError **gerr)
+{
+    cb_ctx_t *cb_ctx = NULL;
+
+    NEW_CB_CTX;
+    cb_ctx->stream_cb       = stream;
+    cb_ctx->list_cb_free    = (GDestroyNotify) bl_value_list_free;
+    cb_ctx->start_handle_cb = start_handle;
+    cb_ctx->end_handle_cb   = end_handle;
+    bt_string_to_uuid(&cb_ctx->uuid_buf, uuid_str);
+    cb_ctx->uuid_req = &cb_ctx->uuid_buf;
+    // Add the value of the UUID to each of the values
+    strncpy(cb_ctx->uuid_cb, uuid_str, MAX_LEN_UUID_STR - 1);
+
+    submit_cb(cb_ctx, read_char_all_send);
 exit:
-    return ret;;
+    return cb_ctx;
 }
 
-// Read all the characteristics value associated to this UUID.
-// Return a list of values (bl_value_t *).
-GSList *bl_read_char_all(dev_ctx_t *dev_ctx, char *uuid_str,
-                         bl_primary_t *bl_primary, GError **gerr)
+static cb_ctx_t *read_char_all_start(dev_ctx_t *dev_ctx, char *uuid_str,
+                                     bl_primary_t *bl_primary,
+                                     bl_stream_cb_t *stream,
+                                     bl_req_cb_t *func, void *user_data,
+                                     GError **gerr)
 {
-    GSList  *ret = NULL;
     uint16_t start_handle;
     uint16_t end_handle;
-    cb_ctx_t cb_ctx;
 
     BLUELIB_ENTER_GERR;
     ASSERT_CONNECTED_GERR;
 
-    init_cb_ctx(&cb_ctx, dev_ctx);
-
     if (uuid_str == NULL) {
         GError *err = g_error_new(BL_ERROR_DOMAIN, BL_SEND_REQUEST_ERROR,
                                   "UUID needed\n");
@@ -755,35 +954,24 @@ GSList *bl_read_char_all(dev_ctx_t *dev_ctx, char *uuid_str,
     if (handle_assert(&start_handle, &end_handle, bl_primary, gerr))
         goto exit;
 
-    bt_uuid_t uuid;
-    bt_string_to_uuid(&uuid, uuid_str);
-
-    g_mutex_lock(&ble_dev_mtx);
-    if (!gatt_read_char_by_uuid(dev_ctx->attrib, start_handle, end_handle,
-                                &uuid,
-                                read_by_uuid_cb, &cb_ctx)) {
-        GError *err = g_error_new(BL_ERROR_DOMAIN, BL_SEND_REQUEST_ERROR,
-                                  "Unable to send request\n");
-        PROPAGATE_ERROR;
-        g_mutex_unlock(&ble_dev_mtx);
-        goto exit;
-    }
-    g_mutex_unlock(&ble_dev_mtx);
-
-    wait_for_cb(&cb_ctx, (void **) &ret, gerr);
-
-    if (ret) {
-        // Add the value of the UUID to each of the values
-        for (GSList *l = ret; l; l = l->next) {
-            strcpy(((bl_value_t *)(l->data))->uuid_str, uuid_str);
-        }
-    }
+    return read_by_type_start(dev_ctx, uuid_str, start_handle, end_handle,
+                              stream, func, user_data, gerr);
 exit:
-    return ret;;
+    return NULL;
 }
 
-// Read a characteristic value by UUID on a primary service.
-bl_value_t *bl_read_char(dev_ctx_t *dev_ctx, char *uuid_str,
+// Read all the characteristics value associated to this UUID.
+// Return a list of values (bl_value_t *).
+GSList *bl_read_char_all(dev_ctx_t *dev_ctx, char *uuid_str,
+                         bl_primary_t *bl_primary, GError **gerr)
+{
+    CLEAR_GERROR;
+    return wait_request(read_char_all_start(dev_ctx, uuid_str, bl_primary,
+                                            NULL, NULL, NULL, gerr), gerr);
+}
+
+// Read a characteristic value by UUID on a primary service.
+bl_value_t *bl_read_char(dev_ctx_t *dev_ctx, char *uuid_str,
                          bl_primary_t *bl_primary, GError **gerr)
 {
     CLEAR_GERROR;
@@ -829,32 +1017,33 @@ GSList *bl_read_char_all_blob(dev_ctx_t *dev_ctx, char *uuid_str,
                               bl_primary_t *bl_primary,
                               GError **gerr)
 {
-    GSList *list = bl_get_all_char(dev_ctx, uuid_str, bl_primary, gerr);
+    GSList         *list = bl_get_all_char(dev_ctx, uuid_str, bl_primary,
+                                           gerr);
+    GSList         *ret;
+    bl_read_item_t *items;
+    int             nb   = 0;
 
     if (*gerr || !list)
         return NULL;
 
-    for (GSList *l = list; l && l->data; l = l->next) {
-        bl_value_t *bl_value = bl_read_char_by_char(dev_ctx, l->data, gerr);
-        bl_char_free(l->data);
-        l->data = bl_value;
+    // Same type: read with Read By Type, the long values with Read Blob.
+    items = g_new0(bl_read_item_t, g_slist_length(list));
+    for (GSList *l = list; l && l->data; l = l->next, nb++) {
+        items[nb].handle   = ((bl_char_t *) l->data)->value_handle;
+        items[nb].uuid_str = ((bl_char_t *) l->data)->uuid_str;
     }
-    return list;
+    ret = bl_read_plan(dev_ctx, items, nb, gerr);
+    g_free(items);
+    bl_char_list_free(list);
+    return ret;
 }
 
 // Read a characteristic value of a characteristic.
 bl_value_t *bl_read_char_by_char(dev_ctx_t *dev_ctx, bl_char_t *bl_char,
                                  GError **gerr)
 {
-    bl_value_t *bl_value = read_by_hnd(dev_ctx, bl_char->value_handle, gerr);
-
-    if (!bl_value)
-        return NULL;
-
-    // Add UUID to value
-    strcpy(bl_value->uuid_str, bl_char->uuid_str);
-
-    return bl_value;
+    return read_by_hnd(dev_ctx, bl_char->value_handle, bl_char->uuid_str,
+                       gerr);
 }
 
 /******************************* Read descriptor ***************************/
@@ -869,7 +1058,7 @@ bl_value_t *bl_read_desc(dev_ctx_t *dev_ctx, char *char_uuid_str,
     if (*gerr || !bl_desc)
         return NULL;
 
-    bl_value_t *ret = read_by_hnd(dev_ctx, bl_desc->handle, gerr);
+    bl_value_t *ret = read_by_hnd(dev_ctx, bl_desc->handle, NULL, gerr);
     bl_desc_free(bl_desc);
     return ret;
 }
@@ -879,24 +1068,32 @@ bl_value_t *bl_read_desc(dev_ctx_t *dev_ctx, char *char_uuid_str,
 GSList *bl_read_all_desc(dev_ctx_t *dev_ctx, char *char_uuid_str,
                          bl_primary_t *bl_primary, GError **gerr)
 {
-    GSList *list = bl_get_all_desc(dev_ctx, char_uuid_str, bl_primary, gerr);
+    GSList         *list = bl_get_all_desc(dev_ctx, char_uuid_str, bl_primary,
+                                           gerr);
+    GSList         *ret;
+    bl_read_item_t *items;
+    int             nb   = 0;
 
     if (*gerr || !list)
         return NULL;
 
-    for (GSList *l = list; l && l->data; l = l->next) {
-        bl_value_t *bl_value = bl_read_desc_by_desc(dev_ctx, l->data, gerr);
-        bl_desc_free(l->data);
-        l->data = bl_value;
+    // The reads are queued at once instead of waiting for each one.
+    items = g_new0(bl_read_item_t, g_slist_length(list));
+    for (GSList *l = list; l && l->data; l = l->next, nb++) {
+        items[nb].handle   = ((bl_desc_t *) l->data)->handle;
+        items[nb].uuid_str = ((bl_desc_t *) l->data)->uuid_str;
     }
-    return list;
+    ret = bl_read_plan(dev_ctx, items, nb, gerr);
+    g_free(items);
+    bl_desc_list_free(list);
+    return ret;
 }
 
 // Read descriptor by descriptor.
 bl_value_t *bl_read_desc_by_desc(dev_ctx_t *dev_ctx, bl_desc_t *bl_desc,
                                  GError **gerr)
 {
-    return read_by_hnd(dev_ctx, bl_desc->handle, gerr);
+    return read_by_hnd(dev_ctx, bl_desc->handle, NULL, gerr);
 }
 
 // Read descriptor by characteristic.
@@ -920,55 +1117,483 @@ bl_value_t *bl_read_desc_by_char(dev_ctx_t *dev_ctx, bl_char_t *start_bl_char,
 }
 
 
-/************************ Write characteristic value ***********************/
-// Write a characteristic by handle.
-static int write_by_hnd(dev_ctx_t *dev_ctx, uint16_t handle, uint8_t *value,
-                        size_t size, write_type_t type)
+/******************************* Long read *********************************/
+static guint read_long_send(GAttrib *attrib, cb_ctx_t *cb_ctx)
 {
-    int ret;
-    cb_ctx_t cb_ctx;
+    return gatt_read_blob(attrib, cb_ctx->handle_cb, cb_ctx->offset_cb,
+                          read_long_cb, cb_ctx);
+}
 
-    BLUELIB_ENTER;
-    ASSERT_CONNECTED;
+// Read a long value by handle, given to chunk or else copied into buf.
+// Each response is handled as it arrives, the value is never gathered.
+static cb_ctx_t *read_long_start(dev_ctx_t *dev_ctx, uint16_t handle,
+                                 uint8_t *buf, size_t size,
+                                 bl_chunk_cb_t *chunk, bl_req_cb_t *func,
+                                 void *user_data, GError **gerr)
+{
+    cb_ctx_t *cb_ctx = NULL;
 
-    init_cb_ctx(&cb_ctx, dev_ctx);
+    BLUELIB_ENTER_GERR;
+    ASSERT_CONNECTED_GERR;
 
     if (handle == INVALID_HANDLE) {
-        printf("Error: Invalid handle\n");
-        ret = EINVAL;
+        GError *err = g_error_new(BL_ERROR_DOMAIN, EINVAL,
+                                  "Invalid handle\n");
+        PROPAGATE_ERROR;
         goto exit;
     }
 
-    if ((size == 0) || (value == NULL)) {
-        printf("Error: Invalid value\n");
-        ret = EINVAL;
+    if ((chunk == NULL) && ((buf == NULL) || (size == 0))) {
+        GError *err = g_error_new(BL_ERROR_DOMAIN, BL_MISSING_ARGUMENT_ERROR,
+                                  "Missing buffer\n");
+        PROPAGATE_ERROR;
         goto exit;
     }
 
-    g_mutex_lock(&ble_dev_mtx);
-    if (type == WRITE_REQ) {
-        if (!gatt_write_char(dev_ctx->attrib, handle, value, size,
-                             write_req_cb, &cb_ctx)) {
-            printf("Error: Unable to send request\n");
-            ret = BL_SEND_REQUEST_ERROR;
-            g_mutex_unlock(&ble_dev_mtx);
-            goto exit;
+    NEW_CB_CTX;
+    cb_ctx->handle_cb   = handle;
+    cb_ctx->chunk_cb    = chunk;
+    cb_ctx->buf_cb      = buf;
+    cb_ctx->buf_size_cb = size;
+
+    submit_cb(cb_ctx, read_long_send);
+exit:
+    return cb_ctx;
+}
+
+ssize_t bl_read_long(dev_ctx_t *dev_ctx, bl_char_t *bl_char, uint8_t *buf,
+                     size_t size, GError **gerr)
+{
+    cb_ctx_t *cb_ctx;
+    ssize_t   ret = -1;
+
+    CLEAR_GERROR;
+    cb_ctx = read_long_start(dev_ctx, bl_char->value_handle, buf, size, NULL,
+                             NULL, NULL, gerr);
+    if (cb_ctx == NULL)
+        return -1;
+
+    if (wait_for_cb(cb_ctx, NULL, gerr) == BL_NO_ERROR)
+        ret = cb_ctx->offset_cb;
+    cb_ctx_unref(cb_ctx);
+    return ret;
+}
+
+int bl_read_long_stream(dev_ctx_t *dev_ctx, bl_char_t *bl_char,
+                        bl_chunk_cb_t *chunk, void *user_data)
+{
+    GError   *gerr = NULL;
+    cb_ctx_t *cb_ctx;
+
+    BLUELIB_ENTER;
+
+    cb_ctx = read_long_start(dev_ctx, bl_char->value_handle, NULL, 0, chunk,
+                             NULL, user_data, &gerr);
+    return wait_request_ret(cb_ctx, gerr);
+}
+
+
+/************************** Read multiple values ***************************/
+// Send the handles from pos_cb, as many as the request and the response can
+// hold. The callback sends the following ones.
+static guint read_multi_send(GAttrib *attrib, cb_ctx_t *cb_ctx)
+{
+    uint16_t *handles  = cb_ctx->handles_cb + cb_ctx->pos_cb;
+    int       left     = cb_ctx->nb_handles_cb - cb_ctx->pos_cb;
+    size_t    mtu;
+    size_t    resp_len = 0;
+    int       nb       = 0;
+
+    g_attrib_get_buffer(attrib, &mtu);
+    if (cb_ctx->alone_cb)
+        left = 1;
+    while ((nb < left) && (1 + (nb + 1) * sizeof(uint16_t) <= mtu)) {
+        // The size of the values is unknown with the variable length
+        // variant, only the request limits the number of handles.
+        if (cb_ctx->sizes_cb) {
+            size_t size = cb_ctx->sizes_cb[cb_ctx->pos_cb + nb];
+
+            if (nb && (resp_len + size > mtu - 1))
+                break;
+            resp_len += size;
         }
-        ret = wait_for_cb(&cb_ctx, NULL, NULL);
-    } else {
-        if (!gatt_write_cmd(dev_ctx->attrib, handle, value, size, NULL,
-                            NULL)) {
-            printf("Error: Unable to send write cmd\n");
-            ret = BL_SEND_REQUEST_ERROR;
-            g_mutex_unlock(&ble_dev_mtx);
+        nb++;
+    }
+    cb_ctx->batch_cb = nb;
+
+    // Read Multiple needs two handles at least.
+    if (nb == 1)
+        return gatt_read_char(attrib, handles[0], read_multi_cb, cb_ctx);
+    return gatt_read_multi(attrib, handles, nb, cb_ctx->sizes_cb == NULL,
+                           read_multi_cb, cb_ctx);
+}
+
+static cb_ctx_t *read_multi_start(dev_ctx_t *dev_ctx, uint16_t *handles,
+                                  size_t *sizes, int nb, bl_req_cb_t *func,
+                                  void *user_data, GError **gerr)
+{
+    cb_ctx_t *cb_ctx = NULL;
+
+    BLUELIB_ENTER_GERR;
+    ASSERT_CONNECTED_GERR;
+
+    if ((handles == NULL) || (nb <= 0)) {
+        GError *err = g_error_new(BL_ERROR_DOMAIN, BL_MISSING_ARGUMENT_ERROR,
+                                  "Handles needed\n");
+        PROPAGATE_ERROR;
+        goto exit;
+    }
+
+    for (int i = 0; i < nb; i++) {
+        if ((handles[i] == INVALID_HANDLE) ||
+            (sizes && ((sizes[i] == 0) || (sizes[i] > ATT_MAX_VALUE_LEN)))) {
+            GError *err = g_error_new(BL_ERROR_DOMAIN, EINVAL,
+                                      "Invalid handle or size\n");
+            PROPAGATE_ERROR;
             goto exit;
         }
-        ret = BL_NO_ERROR;
     }
-    g_mutex_unlock(&ble_dev_mtx);
 
+    NEW_CB_CTX;
+    cb_ctx->list_cb_free  = (GDestroyNotify) bl_value_list_free;
+    cb_ctx->nb_handles_cb = nb;
+    cb_ctx->handles_cb    = g_try_new(uint16_t, nb);
+    if (sizes)
+        cb_ctx->sizes_cb  = g_try_new(uint16_t, nb);
+    if ((cb_ctx->handles_cb == NULL) ||
+        (sizes && (cb_ctx->sizes_cb == NULL))) {
+        GError *err = g_error_new(BL_ERROR_DOMAIN, BL_MALLOC_ERROR,
+                                  "Malloc error\n");
+        PROPAGATE_ERROR;
+        cb_ctx_unref(cb_ctx);
+        return NULL;
+    }
+    for (int i = 0; i < nb; i++) {
+        cb_ctx->handles_cb[i] = handles[i];
+        if (sizes)
+            cb_ctx->sizes_cb[i] = sizes[i];
+    }
+
+    submit_cb(cb_ctx, read_multi_send);
 exit:
-    return ret;;
+    return cb_ctx;
+}
+
+GSList *bl_read_multi(dev_ctx_t *dev_ctx, uint16_t *handles, size_t *sizes,
+                      int nb, GError **gerr)
+{
+    CLEAR_GERROR;
+    return wait_request(read_multi_start(dev_ctx, handles, sizes, nb, NULL,
+                                         NULL, gerr), gerr);
+}
+
+
+/****************************** Read planner *******************************/
+// Request of a read plan, they are all queued at once.
+typedef struct {
+    cb_ctx_t *cb_ctx;
+    gboolean  single;   // The result is a value instead of a list of values.
+    size_t    max_size; // Values of this size may be truncated, 0 if none.
+} plan_req_t;
+
+static int cmp_item_handle(gconstpointer a, gconstpointer b)
+{
+    const bl_read_item_t *item_a = *(bl_read_item_t * const *) a;
+    const bl_read_item_t *item_b = *(bl_read_item_t * const *) b;
+
+    return (int) item_a->handle - (int) item_b->handle;
+}
+
+static GSList *plan_add(GSList *reqs, cb_ctx_t *cb_ctx, gboolean single,
+                        size_t max_size)
+{
+    plan_req_t *req = g_new0(plan_req_t, 1);
+
+    req->cb_ctx   = cb_ctx;
+    req->single   = single;
+    req->max_size = max_size;
+    return g_slist_prepend(reqs, req);
+}
+
+// Wait for the requests of the plan and store their values by handle. The
+// values which may be truncated are dropped, they are read again. Only the
+// errors of the single reads are propagated, the items of a failed batch
+// are read again one by one.
+static void plan_gather(GSList *reqs, GHashTable *values, GError **gerr)
+{
+    for (GSList *l = reqs; l; l = l->next) {
+        plan_req_t *req  = l->data;
+        GError     *err  = NULL;
+        GSList     *list = NULL;
+        void       *ret  = wait_request(req->cb_ctx, &err);
+
+        if (err) {
+            if (req->single && !*gerr)
+                g_propagate_error(gerr, err);
+            else
+                g_error_free(err);
+        }
+
+        list = req->single ? g_slist_prepend(NULL, ret) : ret;
+        for (GSList *v = list; v; v = v->next) {
+            bl_value_t *bl_value = v->data;
+
+            if (bl_value == NULL)
+                continue;
+            if (req->max_size && (bl_value->data_size >= req->max_size))
+                bl_value_free(bl_value);
+            else
+                g_hash_table_replace(values,
+                                     GUINT_TO_POINTER(bl_value->handle),
+                                     bl_value);
+        }
+        g_slist_free(list);
+        g_free(req);
+    }
+    g_slist_free(reqs);
+}
+
+GSList *bl_read_plan(dev_ctx_t *dev_ctx, bl_read_item_t *items, int nb,
+                     GError **gerr)
+{
+    GHashTable *values;
+    GPtrArray  *sorted;
+    gboolean   *planned;
+    uint16_t   *handles;
+    size_t     *sizes;
+    GSList     *reqs     = NULL;
+    GSList     *ret      = NULL;
+    size_t      mtu      = ATT_DEFAULT_LE_MTU;
+    size_t      type_max;
+    int         nb_multi = 0;
+
+    CLEAR_GERROR;
+    BLUELIB_ENTER_GERR;
+    ASSERT_CONNECTED_GERR;
+
+    if ((items == NULL) || (nb <= 0)) {
+        GError *err = g_error_new(BL_ERROR_DOMAIN, BL_MISSING_ARGUMENT_ERROR,
+                                  "Items needed\n");
+        PROPAGATE_ERROR;
+        goto exit;
+    }
+
+    g_mutex_lock(&dev_ctx->mtx);
+    if (dev_ctx->attrib)
+        g_attrib_get_buffer(dev_ctx->attrib, &mtu);
+    g_mutex_unlock(&dev_ctx->mtx);
+    // Read By Type entries: length on one byte, handle, value.
+    type_max = MIN(mtu - 4, 253);
+
+    values  = g_hash_table_new_full(NULL, NULL, NULL,
+                                    (GDestroyNotify) bl_value_free);
+    planned = g_new0(gboolean, nb);
+    handles = g_new(uint16_t, nb);
+    sizes   = g_new(size_t, nb);
+    sorted  = g_ptr_array_sized_new(nb);
+    for (int i = 0; i < nb; i++)
+        g_ptr_array_add(sorted, &items[i]);
+    g_ptr_array_sort(sorted, cmp_item_handle);
+
+    // Known sizes fitting in a response: Read Multiple, packed up to the MTU.
+    for (guint i = 0; i < sorted->len; i++) {
+        bl_read_item_t *item = g_ptr_array_index(sorted, i);
+
+        if ((item->size == 0) || (item->size > mtu - 1))
+            continue;
+        if (nb_multi && (handles[nb_multi - 1] == item->handle))
+            continue;
+        handles[nb_multi] = item->handle;
+        sizes[nb_multi++] = item->size;
+    }
+    if (nb_multi > 1) {
+        cb_ctx_t *cb_ctx = read_multi_start(dev_ctx, handles, sizes,
+                                            nb_multi, NULL, NULL, gerr);
+        if (cb_ctx == NULL)
+            goto free;
+        reqs = plan_add(reqs, cb_ctx, FALSE, 0);
+        for (int i = 0; i < nb; i++)
+            planned[i] = ((items[i].size != 0) &&
+                          (items[i].size <= mtu - 1));
+    }
+
+    // Unknown sizes sharing a type: one Read By Type over their range. The
+    // values which may have been truncated are read again.
+    for (guint i = 0; i < sorted->len; i++) {
+        bl_read_item_t *item  = g_ptr_array_index(sorted, i);
+        uint16_t        end   = item->handle;
+        int             count = 0;
+
+        if (planned[item - items] || item->size || !item->uuid_str)
+            continue;
+
+        for (guint j = i; j < sorted->len; j++) {
+            bl_read_item_t *other = g_ptr_array_index(sorted, j);
+
+            if (!planned[other - items] && !other->size && other->uuid_str &&
+                !strcmp(other->uuid_str, item->uuid_str)) {
+                planned[other - items] = TRUE;
+                end = other->handle;
+                count++;
+            }
+        }
+
+        if (count > 1) {
+            cb_ctx_t *cb_ctx = read_by_type_start(dev_ctx, item->uuid_str,
+                                                  item->handle, end, NULL,
+                                                  NULL, NULL, gerr);
+            if (cb_ctx == NULL)
+                goto free;
+            reqs = plan_add(reqs, cb_ctx, FALSE, type_max);
+        } else {
+            planned[item - items] = FALSE;
+        }
+    }
+
+    // Everything else: Read Request, continued by Read Blob Requests for the
+    // long values.
+    for (int i = 0; i < nb; i++) {
+        cb_ctx_t *cb_ctx;
+
+        if (planned[i])
+            continue;
+        cb_ctx = read_by_hnd_start(dev_ctx, items[i].handle, NULL, NULL,
+                                   NULL, gerr);
+        if (cb_ctx == NULL)
+            goto free;
+        reqs = plan_add(reqs, cb_ctx, TRUE, 0);
+    }
+
+    plan_gather(g_slist_reverse(reqs), values, gerr);
+    reqs = NULL;
+    if (*gerr)
+        goto free;
+
+    // Read again what is missing or truncated.
+    for (int i = 0; i < nb; i++) {
+        cb_ctx_t *cb_ctx;
+
+        if (g_hash_table_contains(values, GUINT_TO_POINTER(items[i].handle)))
+            continue;
+        cb_ctx = read_by_hnd_start(dev_ctx, items[i].handle, NULL, NULL,
+                                   NULL, gerr);
+        if (cb_ctx == NULL)
+            goto free;
+        reqs = plan_add(reqs, cb_ctx, TRUE, 0);
+        // Only once if the handle appears several times
+        g_hash_table_insert(values, GUINT_TO_POINTER(items[i].handle), NULL);
+    }
+    plan_gather(g_slist_reverse(reqs), values, gerr);
+    reqs = NULL;
+    if (*gerr)
+        goto free;
+
+    // Results in the order of the items
+    for (int i = nb - 1; i >= 0; i--) {
+        bl_value_t *bl_value = g_hash_table_lookup(values,
+                                           GUINT_TO_POINTER(items[i].handle));
+        bl_value_t *copy     = NULL;
+
+        if (bl_value)
+            copy = bl_value_new(items[i].uuid_str, items[i].handle,
+                                bl_value->data_size, bl_value->data);
+        if (copy == NULL) {
+            GError *err = g_error_new(BL_ERROR_DOMAIN, BL_MALLOC_ERROR,
+                                      "Malloc error\n");
+            PROPAGATE_ERROR;
+            bl_value_list_free(ret);
+            ret = NULL;
+            goto free;
+        }
+        ret = g_slist_prepend(ret, copy);
+    }
+
+free:
+    // Requests started before an error
+    plan_gather(reqs, values, gerr);
+    g_hash_table_destroy(values);
+    g_ptr_array_free(sorted, TRUE);
+    g_free(planned);
+    g_free(handles);
+    g_free(sizes);
+exit:
+    return ret;
+}
+
+
+/************************ Write characteristic value ***********************/
+static guint write_by_hnd_send(GAttrib *attrib, cb_ctx_t *cb_ctx)
+{
+    if (cb_ctx->cb_in_notify)
+        return gatt_write_cmd(attrib, cb_ctx->handle_cb, cb_ctx->value_cb,
+                              cb_ctx->value_size_cb, write_cmd_cb, cb_ctx);
+    return gatt_write_char(attrib, cb_ctx->handle_cb, cb_ctx->value_cb,
+                           cb_ctx->value_size_cb, write_req_cb, cb_ctx);
+}
+
+// Write a characteristic by handle.
+// A write command has no response, it is completed once sent.
+// The value is copied, the caller may release it right away.
+static cb_ctx_t *write_by_hnd_start(dev_ctx_t *dev_ctx, uint16_t handle,
+                                    uint8_t *value, size_t size,
+                                    write_type_t type, bl_req_cb_t *func,
+                                    void *user_data, GError **gerr)
+{
+    cb_ctx_t *cb_ctx = NULL;
+
+    BLUELIB_ENTER_GERR;
+    ASSERT_CONNECTED_GERR;
+
+    if (handle == INVALID_HANDLE) {
+        GError *err = g_error_new(BL_ERROR_DOMAIN, EINVAL,
+                                  "Invalid handle\n");
+        PROPAGATE_ERROR;
+        goto exit;
+    }
+
+    if ((size == 0) || (value == NULL)) {
+        GError *err = g_error_new(BL_ERROR_DOMAIN, EINVAL,
+                                  "Invalid value\n");
+        PROPAGATE_ERROR;
+        goto exit;
+    }
+
+    NEW_CB_CTX;
+    cb_ctx->cb_in_notify  = (type != WRITE_REQ);
+    cb_ctx->handle_cb     = handle;
+    cb_ctx->value_size_cb = size;
+    cb_ctx->value_cb      = g_try_malloc(size);
+    if (cb_ctx->value_cb == NULL) {
+        GError *err = g_error_new(BL_ERROR_DOMAIN, BL_MALLOC_ERROR,
+                                  "Malloc error\n");
+        PROPAGATE_ERROR;
+        cb_ctx_unref(cb_ctx);
+        return NULL;
+    }
+    memcpy(cb_ctx->value_cb, value, size);
+
+    submit_cb(cb_ctx, write_by_hnd_send);
+exit:
+    return cb_ctx;
+}
+
+static int write_by_hnd(dev_ctx_t *dev_ctx, uint16_t handle, uint8_t *value,
+                        size_t size, write_type_t type)
+{
+    GError   *gerr = NULL;
+    cb_ctx_t *cb_ctx;
+
+    BLUELIB_ENTER;
+
+    cb_ctx = write_by_hnd_start(dev_ctx, handle, value, size, type, NULL,
+                                NULL, &gerr);
+
+    // Do not wait for the write commands to be sent.
+    if (cb_ctx && (type != WRITE_REQ)) {
+        cb_ctx_unref(cb_ctx);
+        return BL_NO_ERROR;
+    }
+    return wait_request_ret(cb_ctx, gerr);
 }
 
 // Write a characteristic value by UUID on a primary service
@@ -1008,6 +1633,183 @@ int bl_write_char_by_char(dev_ctx_t *dev_ctx, bl_char_t *bl_char,
 }
 
 
+/***************************** Streaming write *****************************/
+// Allocate the state of a streaming write, its data is set by the caller.
+// Returns NULL on malloc error.
+static write_stream_t *write_stream_new(int window,
+                                        bl_progress_cb_t *progress,
+                                        void *progress_data)
+{
+    write_stream_t *ws = g_try_new0(write_stream_t, 1);
+
+    if (ws == NULL)
+        return NULL;
+
+    ws->progress      = progress;
+    ws->progress_data = progress_data;
+    ws->window        = (window > 0) ? window : BL_DEFAULT_WRITE_WINDOW;
+    g_queue_init(&ws->chunks);
+    return ws;
+}
+
+// Write the stream ws to a characteristic by handle, see write_stream_send.
+// ws is released with the request, or right away on failure.
+static cb_ctx_t *write_stream_start(dev_ctx_t *dev_ctx, uint16_t handle,
+                                    write_stream_t *ws, bl_req_cb_t *func,
+                                    void *user_data, GError **gerr)
+{
+    cb_ctx_t *cb_ctx = NULL;
+
+    if (dev_ctx == NULL) {
+        GError *err = g_error_new(BL_ERROR_DOMAIN, BL_NO_CTX_ERROR,
+                                  "No context given\n");
+        PROPAGATE_ERROR;
+        goto exit;
+    }
+    ASSERT_CONNECTED_GERR;
+
+    if (ws == NULL) {
+        GError *err = g_error_new(BL_ERROR_DOMAIN, BL_MALLOC_ERROR,
+                                  "Malloc error\n");
+        PROPAGATE_ERROR;
+        goto exit;
+    }
+
+    if (handle == INVALID_HANDLE) {
+        GError *err = g_error_new(BL_ERROR_DOMAIN, EINVAL,
+                                  "Invalid handle\n");
+        PROPAGATE_ERROR;
+        goto exit;
+    }
+
+    NEW_CB_CTX;
+    cb_ctx->wstream_cb   = ws;
+    cb_ctx->handle_cb    = handle;
+    cb_ctx->cb_in_notify = TRUE;
+
+    submit_cb(cb_ctx, write_stream_send);
+    return cb_ctx;
+exit:
+    if (ws)
+        write_stream_free(ws);
+    return cb_ctx;
+}
+
+static cb_ctx_t *write_src_start(dev_ctx_t *dev_ctx, bl_char_t *bl_char,
+                                 bl_write_src_t *src, void *src_data,
+                                 int window, bl_progress_cb_t *progress,
+                                 void *progress_data, bl_req_cb_t *func,
+                                 void *user_data, GError **gerr)
+{
+    write_stream_t *ws;
+
+    if (src == NULL) {
+        GError *err = g_error_new(BL_ERROR_DOMAIN, BL_MISSING_ARGUMENT_ERROR,
+                                  "Missing source\n");
+        PROPAGATE_ERROR;
+        return NULL;
+    }
+
+    ws = write_stream_new(window, progress, progress_data);
+    if (ws) {
+        ws->src      = src;
+        ws->src_data = src_data;
+    }
+    return write_stream_start(dev_ctx, bl_char->value_handle, ws, func,
+                              user_data, gerr);
+}
+
+// Map the file in memory, the data is sent from the mapping.
+static cb_ctx_t *write_file_start(dev_ctx_t *dev_ctx, bl_char_t *bl_char,
+                                  const char *path, size_t offset,
+                                  int window, bl_progress_cb_t *progress,
+                                  void *progress_data, bl_req_cb_t *func,
+                                  void *user_data, GError **gerr)
+{
+    GError         *err  = NULL;
+    GMappedFile    *file = g_mapped_file_new(path, FALSE, &err);
+    write_stream_t *ws;
+
+    if (file == NULL) {
+        PROPAGATE_ERROR;
+        return NULL;
+    }
+
+    if (offset > g_mapped_file_get_length(file)) {
+        err = g_error_new(BL_ERROR_DOMAIN, EINVAL, "Offset out of file\n");
+        PROPAGATE_ERROR;
+        g_mapped_file_unref(file);
+        return NULL;
+    }
+
+    ws = write_stream_new(window, progress, progress_data);
+    if (ws == NULL)
+        g_mapped_file_unref(file);
+    else {
+        ws->file = file;
+        ws->data = (uint8_t *) g_mapped_file_get_contents(file) + offset;
+        ws->size = g_mapped_file_get_length(file) - offset;
+    }
+    return write_stream_start(dev_ctx, bl_char->value_handle, ws, func,
+                              user_data, gerr);
+}
+
+int bl_write_stream(dev_ctx_t *dev_ctx, bl_char_t *bl_char,
+                    bl_write_src_t *src, void *src_data, int window,
+                    bl_progress_cb_t *progress, void *progress_data)
+{
+    GError   *gerr = NULL;
+    cb_ctx_t *cb_ctx;
+
+    BLUELIB_ENTER;
+
+    cb_ctx = write_src_start(dev_ctx, bl_char, src, src_data, window,
+                             progress, progress_data, NULL, NULL, &gerr);
+    return wait_request_ret(cb_ctx, gerr);
+}
+
+int bl_write_data(dev_ctx_t *dev_ctx, bl_char_t *bl_char, uint8_t *data,
+                  size_t size, int window, bl_progress_cb_t *progress,
+                  void *progress_data)
+{
+    GError         *gerr = NULL;
+    write_stream_t *ws;
+    cb_ctx_t       *cb_ctx;
+
+    BLUELIB_ENTER;
+
+    if ((size == 0) || (data == NULL)) {
+        printf("Error: Invalid value\n");
+        return EINVAL;
+    }
+
+    // A cancel ends the request with commands still queued, they get a copy
+    // of data.
+    ws = write_stream_new(window, progress, progress_data);
+    if (ws) {
+        ws->data = data;
+        ws->size = size;
+    }
+    cb_ctx = write_stream_start(dev_ctx, bl_char->value_handle, ws, NULL,
+                                NULL, &gerr);
+    return wait_request_ret(cb_ctx, gerr);
+}
+
+int bl_write_file(dev_ctx_t *dev_ctx, bl_char_t *bl_char, const char *path,
+                  size_t offset, int window, bl_progress_cb_t *progress,
+                  void *progress_data)
+{
+    GError   *gerr = NULL;
+    cb_ctx_t *cb_ctx;
+
+    BLUELIB_ENTER;
+
+    cb_ctx = write_file_start(dev_ctx, bl_char, path, offset, window,
+                              progress, progress_data, NULL, NULL, &gerr);
+    return wait_request_ret(cb_ctx, gerr);
+}
+
+
 /**************************** Write descriptor *****************************/
 // Write a descriptor of a characteristic by UUID on a primary service.
 int bl_write_desc(dev_ctx_t *dev_ctx, char *char_uuid_str,
@@ -1094,10 +1896,10 @@ int bl_change_sec_level(dev_ctx_t *dev_ctx, const sec_level_t level)
         goto exit;
     }
 
-    g_mutex_lock(&ble_dev_mtx);
+    g_mutex_lock(&dev_ctx->mtx);
     bt_io_set(dev_ctx->iochannel, &gerr, BT_IO_OPT_SEC_LEVEL, sec_level,
               BT_IO_OPT_INVALID);
-    g_mutex_unlock(&ble_dev_mtx);
+    g_mutex_unlock(&dev_ctx->mtx);
 
     if (gerr) {
         printf("Error: %s\n", gerr->message);
@@ -1111,43 +1913,381 @@ exit:
 
 
 /************************* Change MTU for GATT/ATT *************************/
-int bl_change_mtu(dev_ctx_t *dev_ctx, int value)
+static guint change_mtu_send(GAttrib *attrib, cb_ctx_t *cb_ctx)
 {
-    int ret;
-    cb_ctx_t cb_ctx;
+    guint sent = gatt_exchange_mtu(attrib, cb_ctx->dev_ctx->opt_mtu,
+                                   exchange_mtu_cb, cb_ctx);
 
-    BLUELIB_ENTER;
-    ASSERT_CONNECTED;
+    if (!sent)
+        cb_ctx->dev_ctx->opt_mtu = 0;
+    return sent;
+}
+
+static cb_ctx_t *change_mtu_start(dev_ctx_t *dev_ctx, int value,
+                                  bl_req_cb_t *func, void *user_data,
+                                  GError **gerr)
+{
+    cb_ctx_t *cb_ctx = NULL;
 
-    init_cb_ctx(&cb_ctx, dev_ctx);
+    BLUELIB_ENTER_GERR;
+    ASSERT_CONNECTED_GERR;
 
     if (dev_ctx->opt_psm) {
-        printf("Error: Operation is only available for LE transport.\n");
-        ret = BL_LE_ONLY_ERROR;
+        GError *err = g_error_new(BL_ERROR_DOMAIN, BL_LE_ONLY_ERROR,
+                                  "Operation is only available for LE "
+                                  "transport.\n");
+        PROPAGATE_ERROR;
         goto exit;
     }
 
     if (dev_ctx->opt_mtu) {
-        printf("Error: MTU exchange can only occur once per connection.\n");
-        ret = BL_MTU_ALREADY_EXCHANGED_ERROR;
+        GError *err = g_error_new(BL_ERROR_DOMAIN,
+                                  BL_MTU_ALREADY_EXCHANGED_ERROR,
+                                  "MTU exchange can only occur once per "
+                                  "connection.\n");
+        PROPAGATE_ERROR;
         goto exit;
     }
 
-    errno = 0;
-    dev_ctx->opt_mtu = value;
-    if (errno != 0 || dev_ctx->opt_mtu < ATT_DEFAULT_LE_MTU) {
-        printf("Error: Invalid value. Minimum MTU size is %d\n",
-               ATT_DEFAULT_LE_MTU);
-        ret = EINVAL;
+    if (value < ATT_DEFAULT_LE_MTU) {
+        GError *err = g_error_new(BL_ERROR_DOMAIN, EINVAL,
+                                  "Invalid value. Minimum MTU size is %d\n",
+                                  ATT_DEFAULT_LE_MTU);
+        PROPAGATE_ERROR;
         goto exit;
     }
 
-    g_mutex_lock(&ble_dev_mtx);
-    gatt_exchange_mtu(dev_ctx->attrib, dev_ctx->opt_mtu, exchange_mtu_cb,
-                      &cb_ctx);
-    g_mutex_unlock(&ble_dev_mtx);
+    NEW_CB_CTX;
+    dev_ctx->opt_mtu = value;
 
-    ret = wait_for_cb(&cb_ctx, NULL, NULL);
+    submit_cb(cb_ctx, change_mtu_send);
 exit:
-    return ret;;
+    return cb_ctx;
+}
+
+int bl_change_mtu(dev_ctx_t *dev_ctx, int value)
+{
+    GError *gerr = NULL;
+
+    BLUELIB_ENTER;
+
+    return wait_request_ret(change_mtu_start(dev_ctx, value, NULL, NULL,
+                                             &gerr), gerr);
+}
+
+/************************** Asynchronous requests **************************/
+int bl_cancel(dev_ctx_t *dev_ctx, unsigned int req_id)
+{
+    BLUELIB_ENTER;
+
+    return cancel_req(dev_ctx, req_id, BL_CANCELLED_ERROR,
+                      "Request cancelled\n");
+}
+
+int bl_cancel_all(dev_ctx_t *dev_ctx)
+{
+    BLUELIB_ENTER;
+
+    cancel_all_req(dev_ctx, BL_CANCELLED_ERROR, "Request cancelled\n",
+                   FALSE);
+    return BL_NO_ERROR;
+}
+
+unsigned int bl_connect_async(dev_ctx_t *dev_ctx, bl_req_cb_t *func,
+                              void *user_data, GError **gerr)
+{
+    CLEAR_GERROR;
+    return async_request(connect_start(dev_ctx, func, user_data, gerr));
+}
+
+unsigned int bl_get_all_primary_async(dev_ctx_t *dev_ctx, char *uuid_str,
+                                      bl_req_cb_t *func, void *user_data,
+                                      GError **gerr)
+{
+    CLEAR_GERROR;
+    return async_request(get_all_primary_start(dev_ctx, uuid_str, func,
+                                               user_data, gerr));
+}
+
+unsigned int bl_get_included_async(dev_ctx_t *dev_ctx,
+                                   bl_primary_t *bl_primary,
+                                   bl_req_cb_t *func, void *user_data,
+                                   GError **gerr)
+{
+    CLEAR_GERROR;
+    return async_request(get_included_start(dev_ctx, bl_primary, func,
+                                            user_data, gerr));
+}
+
+unsigned int bl_get_all_char_async(dev_ctx_t *dev_ctx, char *uuid_str,
+                                   bl_primary_t *bl_primary,
+                                   bl_req_cb_t *func, void *user_data,
+                                   GError **gerr)
+{
+    CLEAR_GERROR;
+    return async_request(get_all_char_start(dev_ctx, uuid_str, bl_primary,
+                                            func, user_data, gerr));
+}
+
+unsigned int bl_get_all_desc_by_char_async(dev_ctx_t *dev_ctx,
+                                           bl_char_t *start_bl_char,
+                                           bl_char_t *end_bl_char,
+                                           bl_primary_t *bl_primary,
+                                           bl_req_cb_t *func,
+                                           void *user_data, GError **gerr)
+{
+    CLEAR_GERROR;
+    return async_request(get_all_desc_by_char_start(dev_ctx, start_bl_char,
+                                                    end_bl_char, bl_primary,
+                                                    func, user_data, gerr));
+}
+
+unsigned int bl_read_char_all_async(dev_ctx_t *dev_ctx, char *uuid_str,
+                                    bl_primary_t *bl_primary,
+                                    bl_req_cb_t *func, void *user_data,
+                                    GError **gerr)
+{
+    CLEAR_GERROR;
+    return async_request(read_char_all_start(dev_ctx, uuid_str, bl_primary,
+                                             NULL, func, user_data, gerr));
+}
+
+unsigned int bl_read_char_all_stream(dev_ctx_t *dev_ctx, char *uuid_str,
+                                     bl_primary_t *bl_primary,
+                                     bl_stream_cb_t *stream,
+                                     bl_req_cb_t *func, void *user_data,
+                                     GError **gerr)
+{
+    CLEAR_GERROR;
+
+    if (stream == NULL) {
+        GError *err = g_error_new(BL_ERROR_DOMAIN, BL_MISSING_ARGUMENT_ERROR,
+                                  "Stream function needed\n");
+        PROPAGATE_ERROR;
+        return 0;
+    }
+    return async_request(read_char_all_start(dev_ctx, uuid_str, bl_primary,
+                                             stream, func, user_data, gerr));
+}
+
+unsigned int bl_read_char_by_char_async(dev_ctx_t *dev_ctx,
+                                        bl_char_t *bl_char,
+                                        bl_req_cb_t *func, void *user_data,
+                                        GError **gerr)
+{
+    CLEAR_GERROR;
+    return async_request(read_by_hnd_start(dev_ctx, bl_char->value_handle,
+                                           bl_char->uuid_str, func,
+                                           user_data, gerr));
+}
+
+unsigned int bl_read_desc_by_desc_async(dev_ctx_t *dev_ctx,
+                                        bl_desc_t *bl_desc,
+                                        bl_req_cb_t *func, void *user_data,
+                                        GError **gerr)
+{
+    CLEAR_GERROR;
+    return async_request(read_by_hnd_start(dev_ctx, bl_desc->handle, NULL,
+                                           func, user_data, gerr));
+}
+
+unsigned int bl_read_long_async(dev_ctx_t *dev_ctx, bl_char_t *bl_char,
+                                bl_chunk_cb_t *chunk, bl_req_cb_t *func,
+                                void *user_data, GError **gerr)
+{
+    CLEAR_GERROR;
+    return async_request(read_long_start(dev_ctx, bl_char->value_handle,
+                                         NULL, 0, chunk, func, user_data,
+                                         gerr));
+}
+
+unsigned int bl_read_multi_async(dev_ctx_t *dev_ctx, uint16_t *handles,
+                                 size_t *sizes, int nb, bl_req_cb_t *func,
+                                 void *user_data, GError **gerr)
+{
+    CLEAR_GERROR;
+    return async_request(read_multi_start(dev_ctx, handles, sizes, nb, func,
+                                          user_data, gerr));
+}
+
+unsigned int bl_write_char_by_char_async(dev_ctx_t *dev_ctx,
+                                         bl_char_t *bl_char, uint8_t *value,
+                                         size_t size, write_type_t type,
+                                         bl_req_cb_t *func, void *user_data,
+                                         GError **gerr)
+{
+    CLEAR_GERROR;
+    return async_request(write_by_hnd_start(dev_ctx, bl_char->value_handle,
+                                            value, size, type, func,
+                                            user_data, gerr));
+}
+
+unsigned int bl_write_stream_async(dev_ctx_t *dev_ctx, bl_char_t *bl_char,
+                                   bl_write_src_t *src, void *src_data,
+                                   int window, bl_progress_cb_t *progress,
+                                   void *progress_data, bl_req_cb_t *func,
+                                   void *user_data, GError **gerr)
+{
+    CLEAR_GERROR;
+    return async_request(write_src_start(dev_ctx, bl_char, src, src_data,
+                                         window, progress, progress_data,
+                                         func, user_data, gerr));
+}
+
+unsigned int bl_write_file_async(dev_ctx_t *dev_ctx, bl_char_t *bl_char,
+                                 const char *path, size_t offset, int window,
+                                 bl_progress_cb_t *progress,
+                                 void *progress_data, bl_req_cb_t *func,
+                                 void *user_data, GError **gerr)
+{
+    CLEAR_GERROR;
+    return async_request(write_file_start(dev_ctx, bl_char, path, offset,
+                                          window, progress, progress_data,
+                                          func, user_data, gerr));
+}
+
+unsigned int bl_write_desc_by_desc_async(dev_ctx_t *dev_ctx,
+                                         bl_desc_t *bl_desc, uint8_t *value,
+                                         size_t size, bl_req_cb_t *func,
+                                         void *user_data, GError **gerr)
+{
+    CLEAR_GERROR;
+    return async_request(write_by_hnd_start(dev_ctx, bl_desc->handle, value,
+                                            size, WRITE_REQ, func, user_data,
+                                            gerr));
+}
+
+unsigned int bl_change_mtu_async(dev_ctx_t *dev_ctx, int value,
+                                 bl_req_cb_t *func, void *user_data,
+                                 GError **gerr)
+{
+    CLEAR_GERROR;
+    return async_request(change_mtu_start(dev_ctx, value, func, user_data,
+                                          gerr));
+}
+
+/********************************* Futures *********************************/
+bl_future_t *bl_connect_future(dev_ctx_t *dev_ctx, GError **gerr)
+{
+    CLEAR_GERROR;
+    return connect_start(dev_ctx, NULL, NULL, gerr);
+}
+
+bl_future_t *bl_get_all_primary_future(dev_ctx_t *dev_ctx, char *uuid_str,
+                                       GError **gerr)
+{
+    CLEAR_GERROR;
+    return get_all_primary_start(dev_ctx, uuid_str, NULL, NULL, gerr);
+}
+
+bl_future_t *bl_get_included_future(dev_ctx_t *dev_ctx,
+                                    bl_primary_t *bl_primary, GError **gerr)
+{
+    CLEAR_GERROR;
+    return get_included_start(dev_ctx, bl_primary, NULL, NULL, gerr);
+}
+
+bl_future_t *bl_get_all_char_future(dev_ctx_t *dev_ctx, char *uuid_str,
+                                    bl_primary_t *bl_primary, GError **gerr)
+{
+    CLEAR_GERROR;
+    return get_all_char_start(dev_ctx, uuid_str, bl_primary, NULL, NULL,
+                              gerr);
+}
+
+bl_future_t *bl_get_all_desc_by_char_future(dev_ctx_t *dev_ctx,
+                                            bl_char_t *start_bl_char,
+                                            bl_char_t *end_bl_char,
+                                            bl_primary_t *bl_primary,
+                                            GError **gerr)
+{
+    CLEAR_GERROR;
+    return get_all_desc_by_char_start(dev_ctx, start_bl_char, end_bl_char,
+                                      bl_primary, NULL, NULL, gerr);
+}
+
+bl_future_t *bl_read_char_all_future(dev_ctx_t *dev_ctx, char *uuid_str,
+                                     bl_primary_t *bl_primary, GError **gerr)
+{
+    CLEAR_GERROR;
+    return read_char_all_start(dev_ctx, uuid_str, bl_primary, NULL, NULL,
+                               NULL, gerr);
+}
+
+bl_future_t *bl_read_char_by_char_future(dev_ctx_t *dev_ctx,
+                                         bl_char_t *bl_char, GError **gerr)
+{
+    CLEAR_GERROR;
+    return read_by_hnd_start(dev_ctx, bl_char->value_handle,
+                             bl_char->uuid_str, NULL, NULL, gerr);
+}
+
+bl_future_t *bl_read_desc_by_desc_future(dev_ctx_t *dev_ctx,
+                                         bl_desc_t *bl_desc, GError **gerr)
+{
+    CLEAR_GERROR;
+    return read_by_hnd_start(dev_ctx, bl_desc->handle, NULL, NULL, NULL,
+                             gerr);
+}
+
+bl_future_t *bl_read_long_future(dev_ctx_t *dev_ctx, bl_char_t *bl_char,
+                                 bl_chunk_cb_t *chunk, void *user_data,
+                                 GError **gerr)
+{
+    CLEAR_GERROR;
+    return read_long_start(dev_ctx, bl_char->value_handle, NULL, 0, chunk,
+                           NULL, user_data, gerr);
+}
+
+bl_future_t *bl_read_multi_future(dev_ctx_t *dev_ctx, uint16_t *handles,
+                                  size_t *sizes, int nb, GError **gerr)
+{
+    CLEAR_GERROR;
+    return read_multi_start(dev_ctx, handles, sizes, nb, NULL, NULL, gerr);
+}
+
+bl_future_t *bl_write_char_by_char_future(dev_ctx_t *dev_ctx,
+                                          bl_char_t *bl_char, uint8_t *value,
+                                          size_t size, write_type_t type,
+                                          GError **gerr)
+{
+    CLEAR_GERROR;
+    return write_by_hnd_start(dev_ctx, bl_char->value_handle, value, size,
+                              type, NULL, NULL, gerr);
+}
+
+bl_future_t *bl_write_stream_future(dev_ctx_t *dev_ctx, bl_char_t *bl_char,
+                                    bl_write_src_t *src, void *src_data,
+                                    int window, bl_progress_cb_t *progress,
+                                    void *progress_data, GError **gerr)
+{
+    CLEAR_GERROR;
+    return write_src_start(dev_ctx, bl_char, src, src_data, window,
+                           progress, progress_data, NULL, NULL, gerr);
+}
+
+bl_future_t *bl_write_file_future(dev_ctx_t *dev_ctx, bl_char_t *bl_char,
+                                  const char *path, size_t offset,
+                                  int window, bl_progress_cb_t *progress,
+                                  void *progress_data, GError **gerr)
+{
+    CLEAR_GERROR;
+    return write_file_start(dev_ctx, bl_char, path, offset, window,
+                            progress, progress_data, NULL, NULL, gerr);
+}
+
+bl_future_t *bl_write_desc_by_desc_future(dev_ctx_t *dev_ctx,
+                                          bl_desc_t *bl_desc, uint8_t *value,
+                                          size_t size, GError **gerr)
+{
+    CLEAR_GERROR;
+    return write_by_hnd_start(dev_ctx, bl_desc->handle, value, size,
+                              WRITE_REQ, NULL, NULL, gerr);
+}
+
+bl_future_t *bl_change_mtu_future(dev_ctx_t *dev_ctx, int value,
+                                  GError **gerr)
+{
+    CLEAR_GERROR;
+    return change_mtu_start(dev_ctx, value, NULL, NULL, gerr);
 }
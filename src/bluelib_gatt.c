@@ -101,10 +101,33 @@ bl_desc_t *bl_desc_new(char *uuid_str, const uint16_t handle)
     return new_bl_desc;
 }
 
+// The data follows the structure in the same allocation.
 bl_value_t *bl_value_new(char *uuid_str, const uint16_t handle,
                          const size_t data_size, uint8_t *data)
+{
+    bl_value_t *new_bl_value = malloc(sizeof(bl_value_t) + data_size);
+    if (new_bl_value == NULL)
+        return NULL;
+
+    // Initialisation
+    if (uuid_str)
+        strcpy(new_bl_value->uuid_str, uuid_str);
+    else
+        new_bl_value->uuid_str[0] = '\0';
+
+    new_bl_value->handle    = handle;
+    new_bl_value->data_size = data_size;
+    new_bl_value->data      = (uint8_t *) (new_bl_value + 1);
+    new_bl_value->bytes     = NULL;
+    memcpy(new_bl_value->data, data, data_size);
+    return new_bl_value;
+}
+
+bl_value_t *bl_value_new_from_bytes(char *uuid_str, const uint16_t handle,
+                                    GBytes *bytes)
 {
     bl_value_t *new_bl_value = malloc(sizeof(bl_value_t));
+    gsize       size;
     if (new_bl_value == NULL)
         return NULL;
 
@@ -114,10 +137,10 @@ bl_value_t *bl_value_new(char *uuid_str, const uint16_t handle,
     else
         new_bl_value->uuid_str[0] = '\0';
 
-    memcpy(&new_bl_value->handle,    &handle,    sizeof(uint16_t));
-    memcpy(&new_bl_value->data_size, &data_size, sizeof(size_t));
-    new_bl_value->data = malloc(new_bl_value->data_size*sizeof(uint8_t));
-    memcpy(new_bl_value->data, data, new_bl_value->data_size*sizeof(uint8_t));
+    new_bl_value->handle    = handle;
+    new_bl_value->bytes     = g_bytes_ref(bytes);
+    new_bl_value->data      = (uint8_t *) g_bytes_get_data(bytes, &size);
+    new_bl_value->data_size = size;
     return new_bl_value;
 }
 
@@ -184,8 +207,8 @@ void struct_free(void *bl_struct)
 void bl_value_free(bl_value_t *bl_value)
 {
     if (bl_value) {
-        if (bl_value->data)
-            free(bl_value->data);
+        if (bl_value->bytes)
+            g_bytes_unref(bl_value->bytes);
         free(bl_value);
         bl_value = NULL;
     }
@@ -199,9 +222,7 @@ static void free_func(gpointer data)
 
 static void value_free_func(gpointer data)
 {
-    if (((bl_value_t *) data)->data)
-        free(((bl_value_t *) data)->data);
-    free_func(data);
+    bl_value_free(data);
 }
 
 void list_free(GSList *list)
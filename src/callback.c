@@ -39,16 +39,32 @@
 #include "gatt_def.h"
 
 //  Callback global Context
-static GMainLoop  *event_loop    = NULL;
-static GThread    *event_thread  = NULL;
-static GMutex      cb_mutex;
+// Event loop threads, each one runs its own context and owns the devices
+// assigned to it, see get_event_context.
+typedef struct {
+    GMainContext *context; // NULL for the default context
+    GMainLoop    *loop;
+    GThread      *thread;
+} bl_loop_t;
+
+static bl_loop_t   **event_loops    = NULL;
+static int           nb_event_loops = 0;
+static GMainContext *event_context  = NULL; // Given by bl_init_with_context
+static GMutex        cb_mutex;
+static GCond         cb_cond; // Signaled once an event loop is created
+
+// Signaled on every request completion, for bl_future_wait_any/all, when
+// some thread waits there.
+static GMutex      any_done_mtx;
+static GCond       any_done_cond;
+static int         any_done_waiters = 0;
 
 // The callback and the functions are running in two seperate thread, we need
 // to use transport variables to return the results.
 
 
-#define CB_TIMEOUT_S 120 /* For every function that have a callback function.
-                          * We will wait 2 minutes before returning */
+#define CB_LOOP_CHECK_S 1 /* While waiting, check every second that the event
+                           * loop is still there to call us back */
 
 //#define DEBUG_ON       // Activate the Debug print
 #ifdef DEBUG_ON
@@ -72,56 +88,506 @@ static GMutex      cb_mutex;
 /*
  * Global functions
  */
-void init_cb_ctx(cb_ctx_t *cb_ctx, dev_ctx_t *dev_ctx)
+static unsigned int next_req_id = 0;
+
+cb_ctx_t *cb_ctx_new(dev_ctx_t *dev_ctx, bl_req_cb_t *func, void *user_data)
 {
+    cb_ctx_t *cb_ctx = g_try_new0(cb_ctx_t, 1);
+
+    if (cb_ctx == NULL)
+        return NULL;
+
     cb_ctx->dev_ctx = dev_ctx;
+    cb_ctx->refs    = 1;
+    cb_ctx->req_id  = __sync_add_and_fetch(&next_req_id, 1);
+    if (cb_ctx->req_id == 0) // Wrapped around, 0 is reserved for errors
+        cb_ctx->req_id = __sync_add_and_fetch(&next_req_id, 1);
     g_mutex_init(&cb_ctx->pending_cb_mtx);
-    g_mutex_lock(&cb_ctx->pending_cb_mtx);
+    g_cond_init(&cb_ctx->pending_cb_cond);
+    cb_ctx->cb_done = FALSE;
+
+    cb_ctx->async_cb        = func;
+    cb_ctx->async_user_data = user_data;
 
-    cb_ctx->end_handle_cb  = 0;
     cb_ctx->cb_ret_pointer = NULL;
+    cb_ctx->cb_ret_free    = NULL;
     cb_ctx->cb_ret_val     = BL_NO_ERROR;
+    cb_ctx->cb_ret_msg[0]  = '\0';
+    cb_ctx->cb_abort_val   = BL_NO_ERROR;
+    cb_ctx->cb_abort_msg   = NULL;
+    cb_ctx->timeout_source = NULL;
+    cb_ctx->attrib_id      = 0;
+    cb_ctx->cb_in_notify   = FALSE;
+    cb_ctx->link_cb        = FALSE;
+    cb_ctx->send_cb        = NULL;
+    cb_ctx->uuid_req       = NULL;
+    cb_ctx->value_cb       = NULL;
+    cb_ctx->value_size_cb  = 0;
+    cb_ctx->list_cb        = NULL;
+    cb_ctx->list_cb_free   = (GDestroyNotify) list_free;
+    cb_ctx->handles_cb     = NULL;
+    cb_ctx->sizes_cb       = NULL;
+    cb_ctx->stream_cb      = NULL;
+    cb_ctx->nb_pdu_cb      = 0;
+    cb_ctx->wstream_cb     = NULL;
+    cb_ctx->chunk_cb       = NULL;
+    cb_ctx->buf_cb         = NULL;
+    cb_ctx->buf_size_cb    = 0;
+    cb_ctx->offset_cb      = 0;
+    return cb_ctx;
 }
 
+cb_ctx_t *cb_ctx_ref(cb_ctx_t *cb_ctx)
+{
+    __sync_add_and_fetch(&cb_ctx->refs, 1);
+    return cb_ctx;
+}
 
-int wait_for_cb(cb_ctx_t *cb_ctx, void **ret_pointer, GError **gerr)
+void cb_ctx_unref(cb_ctx_t *cb_ctx)
+{
+    if (!cb_ctx || (__sync_sub_and_fetch(&cb_ctx->refs, 1) > 0))
+        return;
+
+    // Nobody retrieved the results, i.e. the waiter timed out
+    if (cb_ctx->cb_ret_pointer && cb_ctx->cb_ret_free)
+        cb_ctx->cb_ret_free(cb_ctx->cb_ret_pointer);
+
+    g_free(cb_ctx->value_cb);
+    if (cb_ctx->list_cb)
+        cb_ctx->list_cb_free(cb_ctx->list_cb);
+    g_free(cb_ctx->handles_cb);
+    g_free(cb_ctx->sizes_cb);
+    if (cb_ctx->wstream_cb)
+        write_stream_free(cb_ctx->wstream_cb);
+    g_mutex_clear(&cb_ctx->pending_cb_mtx);
+    g_cond_clear(&cb_ctx->pending_cb_cond);
+    g_free(cb_ctx);
+}
+
+// Wakes up the threads waiting on several requests at once.
+static void any_done_signal(void)
+{
+    // A waiter registers itself before checking the futures.
+    if (g_atomic_int_get(&any_done_waiters) == 0)
+        return;
+
+    g_mutex_lock(&any_done_mtx);
+    g_cond_broadcast(&any_done_cond);
+    g_mutex_unlock(&any_done_mtx);
+}
+
+static void untrack_cb(cb_ctx_t *cb_ctx)
 {
-    int wait_cnt = 0;
-    if (!g_mutex_trylock(&cb_ctx->pending_cb_mtx) &&
-        is_event_loop_running()) {
-        // Reset return value
-        cb_ctx->cb_ret_val     = BL_NO_CALLBACK_ERROR;
+    dev_ctx_t *dev_ctx = cb_ctx->dev_ctx;
+
+    g_mutex_lock(&dev_ctx->mtx);
+    if (dev_ctx->pending_reqs)
+        g_hash_table_remove(dev_ctx->pending_reqs,
+                            GUINT_TO_POINTER(cb_ctx->req_id));
+    g_mutex_unlock(&dev_ctx->mtx);
+}
+
+// The request is completed, its deadline must not fire anymore.
+static void remove_timeout(GSource *source)
+{
+    if (source) {
+        g_source_destroy(source);
+        g_source_unref(source);
+    }
+}
+
+void signal_cb(cb_ctx_t *cb_ctx)
+{
+    gboolean aborted;
+    GSource *source;
+
+    g_mutex_lock(&cb_ctx->pending_cb_mtx);
+    aborted = cb_ctx->cb_done;
+    cb_ctx->cb_done = TRUE;
+    source = cb_ctx->timeout_source;
+    cb_ctx->timeout_source = NULL;
+    g_cond_broadcast(&cb_ctx->pending_cb_cond);
+    g_mutex_unlock(&cb_ctx->pending_cb_mtx);
+
+    remove_timeout(source);
+    untrack_cb(cb_ctx);
+
+    if (aborted) {
+        // Nobody wants these results anymore.
+        if (cb_ctx->cb_ret_pointer && cb_ctx->cb_ret_free)
+            cb_ctx->cb_ret_free(cb_ctx->cb_ret_pointer);
         cb_ctx->cb_ret_pointer = NULL;
+    } else if (cb_ctx->async_cb) {
+        GError *gerr = NULL;
 
-        printf_dbg("Waiting for callback\n");
-        while (is_event_loop_running() &&
-               !g_mutex_trylock(&cb_ctx->pending_cb_mtx)) {
-            usleep(100000);
-
-            if (wait_cnt < CB_TIMEOUT_S*10) {
-                wait_cnt++;
-            } else {
-                GError *err = g_error_new(BL_ERROR_DOMAIN,
-                                          BL_NO_CALLBACK_ERROR,
-                                          "Timeout no callback received\n");
-                printf_dbg("%s", err->message);
-                PROPAGATE_ERROR;
-                set_conn_state(cb_ctx->dev_ctx, STATE_DISCONNECTED);
-                return BL_NO_CALLBACK_ERROR;
-            }
+        if (cb_ctx->cb_ret_val != BL_NO_ERROR)
+            gerr = g_error_new(BL_ERROR_DOMAIN, cb_ctx->cb_ret_val, "%s",
+                               cb_ctx->cb_ret_msg);
+
+        // The results belong to the user from now on.
+        cb_ctx->async_cb(cb_ctx->dev_ctx, cb_ctx->req_id,
+                         cb_ctx->cb_ret_pointer, gerr,
+                         cb_ctx->async_user_data);
+        cb_ctx->cb_ret_pointer = NULL;
+        if (gerr)
+            g_error_free(gerr);
+    }
+    any_done_signal();
+
+    cb_ctx_unref(cb_ctx);
+}
+
+// Complete the request without calling its completion function yet.
+static gboolean abort_req(cb_ctx_t *cb_ctx, int val, const char *msg)
+{
+    GSource *source;
+
+    g_mutex_lock(&cb_ctx->pending_cb_mtx);
+    if (cb_ctx->cb_done) {
+        g_mutex_unlock(&cb_ctx->pending_cb_mtx);
+        return FALSE;
+    }
+    cb_ctx->cb_abort_val = val;
+    cb_ctx->cb_abort_msg = msg;
+    cb_ctx->cb_done      = TRUE;
+    source = cb_ctx->timeout_source;
+    cb_ctx->timeout_source = NULL;
+    g_cond_broadcast(&cb_ctx->pending_cb_cond);
+    g_mutex_unlock(&cb_ctx->pending_cb_mtx);
+
+    remove_timeout(source);
+    untrack_cb(cb_ctx);
+    any_done_signal();
+    return TRUE;
+}
+
+// Give the error of an aborted request to its completion function, from the
+// event loop of the device.
+static void call_aborted(cb_ctx_t *cb_ctx)
+{
+    GError *gerr;
+
+    if (cb_ctx->async_cb == NULL)
+        return;
+
+    gerr = g_error_new(BL_ERROR_DOMAIN, cb_ctx->cb_abort_val, "%s",
+                       cb_ctx->cb_abort_msg);
+    cb_ctx->async_cb(cb_ctx->dev_ctx, cb_ctx->req_id, NULL, gerr,
+                     cb_ctx->async_user_data);
+    g_error_free(gerr);
+}
+
+gboolean abort_cb(cb_ctx_t *cb_ctx, int val, const char *msg)
+{
+    if (!abort_req(cb_ctx, val, msg))
+        return FALSE;
+
+    call_aborted(cb_ctx);
+    return TRUE;
+}
+
+void track_cb(cb_ctx_t *cb_ctx, guint attrib_id)
+{
+    dev_ctx_t *dev_ctx = cb_ctx->dev_ctx;
+
+    g_mutex_lock(&dev_ctx->mtx);
+    g_mutex_lock(&cb_ctx->pending_cb_mtx);
+    cb_ctx->attrib_id = attrib_id;
+    // The callback may have been called already
+    if (!cb_ctx->cb_done) {
+        if (dev_ctx->pending_reqs == NULL)
+            dev_ctx->pending_reqs = g_hash_table_new(NULL, NULL);
+        g_hash_table_insert(dev_ctx->pending_reqs,
+                            GUINT_TO_POINTER(cb_ctx->req_id), cb_ctx);
+    }
+    g_mutex_unlock(&cb_ctx->pending_cb_mtx);
+    g_mutex_unlock(&dev_ctx->mtx);
+}
+
+void set_cb_attrib_id(cb_ctx_t *cb_ctx, guint attrib_id)
+{
+    g_mutex_lock(&cb_ctx->pending_cb_mtx);
+    cb_ctx->attrib_id = attrib_id;
+    g_mutex_unlock(&cb_ctx->pending_cb_mtx);
+}
+
+// Send the requests queued on the device, from its event loop.
+static gboolean send_queued_req(gpointer user_data)
+{
+    dev_ctx_t *dev_ctx = user_data;
+    GQueue     queue   = G_QUEUE_INIT;
+    GAttrib   *attrib;
+    cb_ctx_t  *cb_ctx;
+
+    g_mutex_lock(&dev_ctx->mtx);
+    queue = dev_ctx->req_queue;
+    g_queue_init(&dev_ctx->req_queue);
+    dev_ctx->req_scheduled = FALSE;
+    attrib = dev_ctx->attrib ? g_attrib_ref(dev_ctx->attrib) : NULL;
+    g_mutex_unlock(&dev_ctx->mtx);
+
+    while ((cb_ctx = g_queue_pop_head(&queue))) {
+        guint sent = 0;
+
+        // Cancelled or timed out while queued
+        if (bl_future_poll(cb_ctx)) {
+            cb_ctx_unref(cb_ctx);
+            continue;
+        }
+
+        // The queue reference goes to the callback.
+        if (attrib)
+            sent = cb_ctx->send_cb(attrib, cb_ctx);
+        if (sent) {
+            set_cb_attrib_id(cb_ctx, sent);
+            continue;
         }
+
+        printf_dbg("Request %u: unable to send\n", cb_ctx->req_id);
+        abort_cb(cb_ctx, BL_SEND_REQUEST_ERROR, "Unable to send request\n");
+        cb_ctx_unref(cb_ctx);
     }
 
-    if (!is_event_loop_running()) {
-        set_conn_state(cb_ctx->dev_ctx, STATE_DISCONNECTED);
-        GError *err = g_error_new(BL_ERROR_DOMAIN, BL_DISCONNECTED_ERROR,
-                                  "Event loop is not running\n");
+    if (attrib)
+        g_attrib_unref(attrib);
+    return FALSE;
+}
+
+void submit_cb(cb_ctx_t *cb_ctx, cb_send_t *send)
+{
+    dev_ctx_t *dev_ctx = cb_ctx->dev_ctx;
+    gboolean   schedule;
+
+    cb_ctx->send_cb = send;
+    track_cb(cb_ctx, 0);
+    set_cb_timeout(cb_ctx, dev_ctx->opt_timeout_ms);
+
+    g_mutex_lock(&dev_ctx->mtx);
+    g_queue_push_tail(&dev_ctx->req_queue, cb_ctx_ref(cb_ctx));
+    // A single wake up sends everything queued meanwhile.
+    schedule = !dev_ctx->req_scheduled;
+    dev_ctx->req_scheduled = TRUE;
+    g_mutex_unlock(&dev_ctx->mtx);
+
+    // Runs right away if the calling thread owns the context.
+    if (schedule)
+        g_main_context_invoke(get_event_context(dev_ctx), send_queued_req,
+                              dev_ctx);
+}
+
+typedef struct {
+    cb_ctx_t  *cb_ctx;
+    cb_loop_t *func;
+    void      *data;
+} loop_call_t;
+
+static gboolean loop_call_cb(gpointer user_data)
+{
+    loop_call_t *call   = user_data;
+    cb_ctx_t    *cb_ctx = call->cb_ctx;
+
+    cb_ctx->cb_ret_val = call->func(cb_ctx->dev_ctx, call->data);
+    signal_cb(cb_ctx_ref(cb_ctx));
+    return FALSE;
+}
+
+static void loop_call_free(gpointer user_data)
+{
+    loop_call_t *call = user_data;
+
+    cb_ctx_unref(call->cb_ctx);
+    g_free(call);
+}
+
+int run_in_loop(dev_ctx_t *dev_ctx, cb_loop_t *func, void *data)
+{
+    loop_call_t *call;
+    cb_ctx_t    *cb_ctx;
+    int          ret;
+
+    // Nobody else uses the GAttrib.
+    if (!is_event_loop_running())
+        return func(dev_ctx, data);
+
+    call = g_try_new(loop_call_t, 1);
+    if (call == NULL)
+        return BL_MALLOC_ERROR;
+
+    cb_ctx = cb_ctx_new(dev_ctx, NULL, NULL);
+    if (cb_ctx == NULL) {
+        g_free(call);
+        return BL_MALLOC_ERROR;
+    }
+    call->cb_ctx = cb_ctx_ref(cb_ctx);
+    call->func   = func;
+    call->data   = data;
+
+    g_main_context_invoke_full(get_event_context(dev_ctx),
+                               G_PRIORITY_DEFAULT, loop_call_cb, call,
+                               loop_call_free);
+    ret = wait_for_cb(cb_ctx, NULL, NULL);
+    cb_ctx_unref(cb_ctx);
+    return ret;
+}
+
+// Remove the command of an aborted request from the GAttrib queue, so the
+// following ones do not wait behind it. If it is already sent, only its
+// response is ignored. Must be called from the thread using the GAttrib.
+static void cancel_attrib_cmd(cb_ctx_t *cb_ctx)
+{
+    GAttrib *attrib = cb_ctx->dev_ctx->attrib;
+    guint    attrib_id;
+
+    g_mutex_lock(&cb_ctx->pending_cb_mtx);
+    attrib_id = cb_ctx->attrib_id;
+    cb_ctx->attrib_id = 0;
+    g_mutex_unlock(&cb_ctx->pending_cb_mtx);
+
+    if (!attrib || !attrib_id)
+        return;
+
+    // The callback will never be called, release its reference.
+    if (g_attrib_cancel(attrib, attrib_id) && !cb_ctx->cb_in_notify)
+        cb_ctx_unref(cb_ctx);
+}
+
+static gboolean cancel_in_loop(gpointer user_data)
+{
+    cancel_attrib_cmd(user_data);
+    call_aborted(user_data);
+    return FALSE;
+}
+
+gboolean cancel_cb(cb_ctx_t *cb_ctx, int val, const char *msg)
+{
+    // The waiters wake up right away, the completion function is called
+    // from the event loop like for any other completion.
+    if (!abort_req(cb_ctx, val, msg))
+        return FALSE;
+
+    g_main_context_invoke_full(get_event_context(cb_ctx->dev_ctx),
+                               G_PRIORITY_DEFAULT, cancel_in_loop,
+                               cb_ctx_ref(cb_ctx),
+                               (GDestroyNotify) cb_ctx_unref);
+    return TRUE;
+}
+
+int cancel_req(dev_ctx_t *dev_ctx, unsigned int req_id, int val,
+               const char *msg)
+{
+    cb_ctx_t *cb_ctx = NULL;
+    int       ret    = EINVAL;
+
+    g_mutex_lock(&dev_ctx->mtx);
+    if (dev_ctx->pending_reqs)
+        cb_ctx = g_hash_table_lookup(dev_ctx->pending_reqs,
+                                     GUINT_TO_POINTER(req_id));
+    if (cb_ctx)
+        cb_ctx_ref(cb_ctx);
+    g_mutex_unlock(&dev_ctx->mtx);
+
+    if (cb_ctx) {
+        if (cancel_cb(cb_ctx, val, msg))
+            ret = BL_NO_ERROR;
+        cb_ctx_unref(cb_ctx);
+    }
+    return ret;
+}
+
+void cancel_all_req(dev_ctx_t *dev_ctx, int val, const char *msg,
+                    gboolean now)
+{
+    GHashTableIter iter;
+    gpointer       cb_ctx;
+    GSList        *list = NULL;
+
+    g_mutex_lock(&dev_ctx->mtx);
+    if (dev_ctx->pending_reqs) {
+        g_hash_table_iter_init(&iter, dev_ctx->pending_reqs);
+        while (g_hash_table_iter_next(&iter, NULL, &cb_ctx))
+            list = g_slist_prepend(list, cb_ctx_ref(cb_ctx));
+    }
+    g_mutex_unlock(&dev_ctx->mtx);
+
+    for (GSList *l = list; l; l = l->next) {
+        if (now) {
+            if (abort_cb(l->data, val, msg))
+                cancel_attrib_cmd(l->data);
+        } else
+            cancel_cb(l->data, val, msg);
+        cb_ctx_unref(l->data);
+    }
+    g_slist_free(list);
+}
+
+static gboolean timeout_cb(gpointer user_data)
+{
+    cb_ctx_t *cb_ctx = user_data;
+    GSource  *source = g_main_current_source();
+
+    g_mutex_lock(&cb_ctx->pending_cb_mtx);
+    if (cb_ctx->timeout_source != source) {
+        // Replaced or removed meanwhile
+        g_mutex_unlock(&cb_ctx->pending_cb_mtx);
+        return FALSE;
+    }
+    cb_ctx->timeout_source = NULL;
+    g_mutex_unlock(&cb_ctx->pending_cb_mtx);
+    g_source_unref(source);
+
+    printf_dbg("Request %u timed out\n", cb_ctx->req_id);
+    if (abort_cb(cb_ctx, BL_TIMEOUT_ERROR, "Request timed out\n")) {
+        cancel_attrib_cmd(cb_ctx);
+        // The connection failed, the link must not stay up.
+        if (cb_ctx->link_cb)
+            disconnect_io(cb_ctx->dev_ctx);
+    }
+    return FALSE;
+}
+
+gboolean set_cb_timeout(cb_ctx_t *cb_ctx, int timeout_ms)
+{
+    GSource *old_source;
+
+    g_mutex_lock(&cb_ctx->pending_cb_mtx);
+    if (cb_ctx->cb_done) {
+        g_mutex_unlock(&cb_ctx->pending_cb_mtx);
+        return FALSE;
+    }
+
+    old_source = cb_ctx->timeout_source;
+    cb_ctx->timeout_source = NULL;
+    if (timeout_ms > 0) {
+        // The source holds a reference on the context until it is destroyed
+        cb_ctx->timeout_source = g_timeout_source_new(timeout_ms);
+        g_source_set_callback(cb_ctx->timeout_source, timeout_cb,
+                              cb_ctx_ref(cb_ctx),
+                              (GDestroyNotify) cb_ctx_unref);
+        g_source_attach(cb_ctx->timeout_source,
+                        get_event_context(cb_ctx->dev_ctx));
+    }
+    g_mutex_unlock(&cb_ctx->pending_cb_mtx);
+
+    remove_timeout(old_source);
+    return TRUE;
+}
+
+// Hand the results of a completed request over.
+static int get_results(cb_ctx_t *cb_ctx, void **ret_pointer, GError **gerr)
+{
+    if (ret_pointer)
+        *ret_pointer = NULL;
+
+    if (cb_ctx->cb_abort_val != BL_NO_ERROR) {
+        GError *err = g_error_new(BL_ERROR_DOMAIN, cb_ctx->cb_abort_val,
+                                  "%s", cb_ctx->cb_abort_msg);
         printf_dbg("%s", err->message);
         PROPAGATE_ERROR;
-        return BL_DISCONNECTED_ERROR;
-    } else
-        printf_dbg("Callback returned <%d, %p>\n", cb_ctx->cb_ret_val,
-                   cb_ctx->cb_ret_pointer);
+        return cb_ctx->cb_abort_val;
+    }
+
+    printf_dbg("Callback returned <%d, %p>\n", cb_ctx->cb_ret_val,
+               cb_ctx->cb_ret_pointer);
 
     if (cb_ctx->cb_ret_val != BL_NO_ERROR) {
         GError *err = g_error_new(BL_ERROR_DOMAIN, cb_ctx->cb_ret_val, "%s",
@@ -133,90 +599,437 @@ int wait_for_cb(cb_ctx_t *cb_ctx, void **ret_pointer, GError **gerr)
         printf_dbg("%s", cb_ctx->cb_ret_msg);
     }
     strcpy(cb_ctx->cb_ret_msg, "\0");
-    if (ret_pointer)
+    if (ret_pointer) {
         *ret_pointer = cb_ctx->cb_ret_pointer;
+        cb_ctx->cb_ret_pointer = NULL;
+    }
     return cb_ctx->cb_ret_val;
 }
 
+int wait_for_cb(cb_ctx_t *cb_ctx, void **ret_pointer, GError **gerr)
+{
+    GMainContext *context = get_event_context(cb_ctx->dev_ctx);
+
+    printf_dbg("Waiting for callback\n");
+    if (acquire_event_context(context)) {
+        // We are the thread of the event loop, nobody else will run it.
+        while (!bl_future_poll(cb_ctx) && is_event_loop_running())
+            g_main_context_iteration(context, TRUE);
+        g_main_context_release(context);
+    } else {
+        // The deadline of the request is enforced by the event loop, we only
+        // check that it is still there to call us back.
+        g_mutex_lock(&cb_ctx->pending_cb_mtx);
+        while (!cb_ctx->cb_done && is_event_loop_running())
+            g_cond_wait_until(&cb_ctx->pending_cb_cond,
+                              &cb_ctx->pending_cb_mtx,
+                              g_get_monotonic_time() +
+                              CB_LOOP_CHECK_S * G_TIME_SPAN_SECOND);
+        g_mutex_unlock(&cb_ctx->pending_cb_mtx);
+    }
+
+    if (!is_event_loop_running()) {
+        set_conn_state(cb_ctx->dev_ctx, STATE_DISCONNECTED);
+        GError *err = g_error_new(BL_ERROR_DOMAIN, BL_DISCONNECTED_ERROR,
+                                  "Event loop is not running\n");
+        printf_dbg("%s", err->message);
+        PROPAGATE_ERROR;
+        return BL_DISCONNECTED_ERROR;
+    }
+
+    return get_results(cb_ctx, ret_pointer, gerr);
+}
+
+
+/*
+ * Futures
+ */
+unsigned int bl_future_get_id(bl_future_t *future)
+{
+    return future->req_id;
+}
+
+gboolean bl_future_poll(bl_future_t *future)
+{
+    gboolean ret;
+
+    g_mutex_lock(&future->pending_cb_mtx);
+    ret = future->cb_done;
+    g_mutex_unlock(&future->pending_cb_mtx);
+    return ret;
+}
+
+static int count_done(bl_future_t **futures, int nb, int *last)
+{
+    int nb_done = 0;
+
+    for (int i = 0; i < nb; i++) {
+        if (futures[i] && bl_future_poll(futures[i])) {
+            nb_done++;
+            *last = i;
+        }
+    }
+    return nb_done;
+}
+
+static gboolean wake_up_cb(gpointer user_data)
+{
+    return FALSE;
+}
+
+// Wait for nb_needed of the futures to be completed, nb_needed = 0 means all
+// of them. Returns the index of the last completed future found or -1.
+static int wait_futures(bl_future_t **futures, int nb, int nb_needed,
+                        int timeout_ms)
+{
+    GMainContext *context  = NULL;
+    gint64        end_time = -1;
+    int           ret      = -1;
+    int           nb_valid = 0;
+
+    for (int i = 0; i < nb; i++) {
+        if (futures[i]) {
+            context = get_event_context(futures[i]->dev_ctx);
+            nb_valid++;
+        }
+    }
+
+    if (nb_valid == 0)
+        return -1;
+    if ((nb_needed == 0) || (nb_needed > nb_valid))
+        nb_needed = nb_valid;
+
+    if (timeout_ms >= 0)
+        end_time = g_get_monotonic_time() +
+                   timeout_ms * G_TIME_SPAN_MILLISECOND;
+
+    if (acquire_event_context(context)) {
+        // We are the thread of the event loop, run it ourselves. A timer
+        // makes sure we do not sleep past the deadline.
+        GSource *wake_up = NULL;
+
+        if (timeout_ms >= 0) {
+            wake_up = g_timeout_source_new(timeout_ms);
+            g_source_set_callback(wake_up, wake_up_cb, NULL, NULL);
+            g_source_attach(wake_up, context);
+        }
+
+        while ((count_done(futures, nb, &ret) < nb_needed) &&
+               is_event_loop_running() &&
+               ((end_time < 0) || (g_get_monotonic_time() < end_time))) {
+            ret = -1;
+            g_main_context_iteration(context, TRUE);
+        }
+        if (count_done(futures, nb, &ret) < nb_needed)
+            ret = -1;
+
+        if (wake_up) {
+            g_source_destroy(wake_up);
+            g_source_unref(wake_up);
+        }
+        g_main_context_release(context);
+        return ret;
+    }
+
+    g_mutex_lock(&any_done_mtx);
+    g_atomic_int_inc(&any_done_waiters);
+    while (1) {
+        if (count_done(futures, nb, &ret) >= nb_needed)
+            break;
+
+        ret = -1;
+        if (!is_event_loop_running())
+            break;
+        if ((end_time >= 0) && (g_get_monotonic_time() >= end_time))
+            break;
+
+        // Woken up by any request completion, check the loop from time to
+        // time as it would not wake us up if it stopped.
+        gint64 wake_time = g_get_monotonic_time() +
+                           CB_LOOP_CHECK_S * G_TIME_SPAN_SECOND;
+        if (end_time >= 0)
+            wake_time = MIN(wake_time, end_time);
+        g_cond_wait_until(&any_done_cond, &any_done_mtx, wake_time);
+    }
+    g_atomic_int_add(&any_done_waiters, -1);
+    g_mutex_unlock(&any_done_mtx);
+    return ret;
+}
+
+gboolean bl_future_wait(bl_future_t *future, int timeout_ms)
+{
+    return wait_futures(&future, 1, 1, timeout_ms) == 0;
+}
+
+int bl_future_wait_any(bl_future_t **futures, int nb, int timeout_ms)
+{
+    return wait_futures(futures, nb, 1, timeout_ms);
+}
+
+gboolean bl_future_wait_all(bl_future_t **futures, int nb, int timeout_ms)
+{
+    for (int i = 0; i < nb; i++)
+        if (futures[i])
+            return wait_futures(futures, nb, 0, timeout_ms) >= 0;
+
+    return TRUE;
+}
+
+int bl_future_get_result(bl_future_t *future, void **result, GError **gerr)
+{
+    if (!bl_future_poll(future)) {
+        GError *err = g_error_new(BL_ERROR_DOMAIN, BL_PENDING_ERROR,
+                                  "Request not completed\n");
+        PROPAGATE_ERROR;
+        if (result)
+            *result = NULL;
+        return BL_PENDING_ERROR;
+    }
+
+    return get_results(future, result, gerr);
+}
+
+gboolean bl_future_set_timeout(bl_future_t *future, int timeout_ms)
+{
+    return set_cb_timeout(future, timeout_ms);
+}
+
+gboolean bl_future_cancel(bl_future_t *future)
+{
+    return cancel_cb(future, BL_CANCELLED_ERROR, "Request cancelled\n");
+}
+
+void bl_future_free(bl_future_t *future)
+{
+    cb_ctx_unref(future);
+}
+
 
 /*
  * Event loop thread
  */
 static gpointer _event_thread(gpointer data)
 {
+    bl_loop_t *loop = data;
+
     printf_dbg("Event loop START\n");
     g_mutex_lock(&cb_mutex);
-    event_loop = g_main_loop_new(NULL, FALSE);
+    loop->loop = g_main_loop_new(loop->context, FALSE);
+    g_cond_broadcast(&cb_cond);
+    g_mutex_unlock(&cb_mutex);
+    g_main_loop_run(loop->loop);
+
+    // stop_event_loop forgot about us already
+    g_mutex_lock(&cb_mutex);
+    g_main_loop_unref(loop->loop);
+    if (loop->context)
+        g_main_context_unref(loop->context);
+    g_thread_unref(loop->thread);
+    g_free(loop);
     g_mutex_unlock(&cb_mutex);
-    g_main_loop_run(event_loop);
-    g_main_loop_unref(event_loop);
-    event_loop = NULL;
     printf_dbg("Event loop EXIT\n");
     g_thread_exit(0);
     return NULL;
 }
 
-int start_event_loop(GError **gerr)
+int start_event_loop(int nb_loops, GError **gerr)
 {
-    g_mutex_init(&cb_mutex);
+    if (nb_loops < 1) {
+        GError *err = g_error_new(BL_ERROR_DOMAIN, EINVAL,
+                                  "At least one event loop is needed\n");
+        PROPAGATE_ERROR;
+        return -1;
+    }
 
-    event_thread = g_thread_try_new("event_loop", _event_thread, NULL, gerr);
+    g_mutex_lock(&cb_mutex);
+    event_loops = g_new0(bl_loop_t *, nb_loops);
+    for (int i = 0; i < nb_loops; i++) {
+        bl_loop_t *loop = g_new0(bl_loop_t, 1);
+        char      *name = g_strdup_printf("event_loop%d", i);
+
+        // A single loop keeps running the default context
+        if (nb_loops > 1)
+            loop->context = g_main_context_new();
+
+        loop->thread = g_thread_try_new(name, _event_thread, loop, gerr);
+        g_free(name);
+        if (loop->thread == NULL) {
+            printf_dbg("%s\n", (*gerr)->message);
+            if (loop->context)
+                g_main_context_unref(loop->context);
+            g_free(loop);
+            g_mutex_unlock(&cb_mutex);
+            stop_event_loop();
+            return -1;
+        }
 
-    for (int cnt = 0;
-         (!is_event_loop_running()) && (cnt < 60) && (event_thread != NULL);
-         cnt++) {
-        sleep(1);
-        printf_dbg("wait for event loop\n");
+        while (loop->loop == NULL)
+            g_cond_wait(&cb_cond, &cb_mutex);
+        event_loops[i] = loop;
+        g_atomic_int_inc(&nb_event_loops);
     }
+    g_mutex_unlock(&cb_mutex);
 
-    if (event_thread == NULL) {
-        printf_dbg("%s\n", (*gerr)->message);
-        goto error;
+    return 0;
+}
+
+int attach_event_context(GMainContext *context, GError **gerr)
+{
+    if (context == NULL) {
+        GError *err = g_error_new(BL_ERROR_DOMAIN, BL_MISSING_ARGUMENT_ERROR,
+                                  "No context given\n");
+        PROPAGATE_ERROR;
+        return -1;
     }
 
-    return 0;
+    g_mutex_lock(&cb_mutex);
+    if (event_context)
+        g_main_context_unref(event_context);
+    g_atomic_pointer_set(&event_context, g_main_context_ref(context));
+    g_mutex_unlock(&cb_mutex);
 
-error:
-    return -1;
+    return 0;
 }
 
 void stop_event_loop(void)
 {
     g_mutex_lock(&cb_mutex);
-    if (event_loop)
-        g_main_loop_quit(event_loop);
+    for (int i = 0; i < nb_event_loops; i++)
+        g_main_loop_quit(event_loops[i]->loop);
+    g_free(event_loops);
+    event_loops = NULL;
+    g_atomic_int_set(&nb_event_loops, 0);
+
+    if (event_context) {
+        g_main_context_unref(event_context);
+        g_atomic_pointer_set(&event_context, NULL);
+    }
     g_mutex_unlock(&cb_mutex);
 }
 
+// Called on every request, no lock here.
 int is_event_loop_running(void)
 {
+    return (g_atomic_int_get(&nb_event_loops) > 0) ||
+           (g_atomic_pointer_get(&event_context) != NULL);
+}
+
+int get_nb_event_loops(void)
+{
+    return g_atomic_int_get(&nb_event_loops);
+}
+
+void resolve_event_context(dev_ctx_t *dev_ctx)
+{
+    GMainContext *context;
+    guint         idx;
+
     g_mutex_lock(&cb_mutex);
-    int ret = ((event_thread != NULL) && (event_loop != NULL));
+    if (event_context || (nb_event_loops <= 1)) {
+        context = event_context;
+        goto exit;
+    }
+
+    if (dev_ctx->opt_loop >= 0)
+        idx = dev_ctx->opt_loop;
+    else if (dev_ctx->opt_mac_dst)
+        idx = g_str_hash(dev_ctx->opt_mac_dst);
+    else
+        idx = 0;
+    context = event_loops[idx % nb_event_loops]->context;
+exit:
+    // Kept alive even if its event loop stops meanwhile.
+    if (context)
+        g_main_context_ref(context);
     g_mutex_unlock(&cb_mutex);
-    return ret;
+
+    if (dev_ctx->context)
+        g_main_context_unref(dev_ctx->context);
+    dev_ctx->context = context;
+}
+
+// Called on every request, no lock here.
+GMainContext *get_event_context(dev_ctx_t *dev_ctx)
+{
+    return dev_ctx->context;
+}
+
+gboolean acquire_event_context(GMainContext *context)
+{
+    // Our own event loop thread is the only one running the default context
+    if (context == NULL)
+        return FALSE;
+
+    return g_main_context_acquire(context);
 }
 
+
 /*
  * Callback functions
  */
+// End of the connection with the automatic MTU exchange. A refusal only
+// keeps the default MTU, an ATT timeout closes the link.
+static void connect_mtu_cb(guint8 status, const guint8 *pdu, guint16 plen,
+                           gpointer user_data)
+{
+    cb_ctx_t  *cb_ctx  = user_data;
+    dev_ctx_t *dev_ctx = cb_ctx->dev_ctx;
+    uint16_t   mtu;
+
+    printf_dbg("IN connect_mtu_cb\n");
+    if ((status == ATT_ECODE_TIMEOUT) || (status == ATT_ECODE_ABORTED)) {
+        // The GAttrib is stale, closing the link fails the connection.
+        printf("Error: MTU exchange timed out\n");
+        disconnect_io(dev_ctx);
+        goto exit;
+    }
+
+    if (!status && dec_mtu_resp(pdu, plen, &mtu) &&
+        g_attrib_set_mtu(dev_ctx->attrib, MIN(mtu, dev_ctx->opt_mtu)))
+        printf_dbg("MTU set to %d\n", MIN(mtu, dev_ctx->opt_mtu));
+    else
+        printf("Warning: Unable to exchange the MTU\n");
+
+exit:
+    signal_cb(cb_ctx);
+    printf_dbg("OUT connect_mtu_cb\n");
+}
+
 void connect_cb(GIOChannel *io, GError *err, gpointer user_data)
 {
-    cb_ctx_t *cb_ctx = user_data;
+    cb_ctx_t  *cb_ctx  = user_data;
+    dev_ctx_t *dev_ctx = cb_ctx->dev_ctx;
+    guint      attrib_id;
 
     printf_dbg("IN connect_cb\n");
     if (err) {
-        set_conn_state(cb_ctx->dev_ctx, STATE_DISCONNECTED);
+        set_conn_state(dev_ctx, STATE_DISCONNECTED);
         cb_ctx->cb_ret_val = BL_REQUEST_FAIL_ERROR;
         sprintf(cb_ctx->cb_ret_msg, "%s", err->message);
         goto error;
     }
-    cb_ctx->dev_ctx->attrib = g_attrib_new(cb_ctx->dev_ctx->iochannel);
-    set_conn_state(cb_ctx->dev_ctx, STATE_CONNECTED);
+    dev_ctx->attrib = g_attrib_new_full(dev_ctx->iochannel,
+                                        get_event_context(dev_ctx));
+    set_conn_state(dev_ctx, STATE_CONNECTED);
     strcpy(cb_ctx->cb_ret_msg, "Connection successful\n");
     cb_ctx->cb_ret_val = BL_NO_ERROR;
 
+    // Raise the MTU before anything else is sent, within the deadline of
+    // the connection.
+    if (dev_ctx->opt_auto_mtu && !dev_ctx->opt_psm && dev_ctx->attrib) {
+        dev_ctx->opt_mtu = dev_ctx->opt_auto_mtu;
+        attrib_id = gatt_exchange_mtu(dev_ctx->attrib, dev_ctx->opt_mtu,
+                                      connect_mtu_cb, cb_ctx);
+        if (attrib_id) {
+            set_cb_attrib_id(cb_ctx, attrib_id);
+            printf_dbg("OUT connect_cb with MTU exchange\n");
+            return;
+        }
+        dev_ctx->opt_mtu = 0;
+    }
+
 error:
-    g_mutex_unlock(&cb_ctx->pending_cb_mtx);
+    signal_cb(cb_ctx);
     printf_dbg("OUT connect_cb\n");
 }
 
@@ -271,6 +1084,7 @@ void primary_all_cb(GSList *services, guint8 status,
 
     cb_ctx->cb_ret_val = BL_NO_ERROR;
     cb_ctx->cb_ret_pointer = bl_primary_list;
+    cb_ctx->cb_ret_free    = (GDestroyNotify) list_free;
     strcpy(cb_ctx->cb_ret_msg, "Primary callback: Sucess\n");
     goto exit;
 
@@ -280,7 +1094,7 @@ error:
 exit:
     if (l)
         g_slist_free(l);
-    g_mutex_unlock(&cb_ctx->pending_cb_mtx);
+    signal_cb(cb_ctx);
     printf_dbg("OUT primary_all_cb\n");
 }
 
@@ -307,8 +1121,8 @@ void primary_by_uuid_cb(GSList *ranges, guint8 status,
 
     for (l = ranges; l; l = l->next) {
         struct att_range *range = l->data;
-        bl_primary_t *bl_primary = bl_primary_new(NULL, 0, range->start,
-                                                  range->end);
+        bl_primary_t *bl_primary = bl_primary_new(cb_ctx->uuid_cb, 0,
+                                                  range->start, range->end);
         free(range);
 
         if (bl_primary == NULL) {
@@ -333,13 +1147,14 @@ void primary_by_uuid_cb(GSList *ranges, guint8 status,
     }
     cb_ctx->cb_ret_val = BL_NO_ERROR;
     cb_ctx->cb_ret_pointer = bl_primary_list;
+    cb_ctx->cb_ret_free    = (GDestroyNotify) list_free;
     goto exit;
 
 error:
     if (bl_primary_list)
         bl_primary_list_free(bl_primary_list);
 exit:
-    g_mutex_unlock(&cb_ctx->pending_cb_mtx);
+    signal_cb(cb_ctx);
     printf_dbg("OUT primary_by_uuid_cb\n");
 }
 
@@ -389,6 +1204,7 @@ void included_cb(GSList *includes, guint8 status, gpointer user_data)
 
     cb_ctx->cb_ret_val     = BL_NO_ERROR;
     cb_ctx->cb_ret_pointer = bl_included_list;
+    cb_ctx->cb_ret_free    = (GDestroyNotify) list_free;
     goto exit;
 
 error:
@@ -397,7 +1213,7 @@ error:
 exit:
     if (l)
         g_slist_free(l);
-    g_mutex_unlock(&cb_ctx->pending_cb_mtx);
+    signal_cb(cb_ctx);
     printf_dbg("OUT included_cb\n");
 }
 
@@ -449,6 +1265,7 @@ void char_by_uuid_cb(GSList *characteristics, guint8 status,
 
     cb_ctx->cb_ret_val     = BL_NO_ERROR;
     cb_ctx->cb_ret_pointer = bl_char_list;
+    cb_ctx->cb_ret_free    = (GDestroyNotify) list_free;
     goto exit;
 
 error:
@@ -457,11 +1274,10 @@ error:
 exit:
     if (l)
         g_slist_free(l);
-    g_mutex_unlock(&cb_ctx->pending_cb_mtx);
+    signal_cb(cb_ctx);
     printf_dbg("OUT char_by_uuid\n");
 }
 
-static GSList *bl_desc_list = NULL;
 void char_desc_cb(guint8 status, const guint8 *pdu, guint16 plen,
                   gpointer user_data) {
     struct att_data_list *list   = NULL;
@@ -511,19 +1327,8 @@ void char_desc_cb(guint8 status, const guint8 *pdu, guint16 plen,
                        "Characteristic descriptor callback: Malloc error\n");
                 goto exit;
             }
-            if (bl_desc_list == NULL) {
-                bl_desc_list = g_slist_alloc();
-                if (bl_desc_list == NULL) {
-                    cb_ctx->cb_ret_val = BL_MALLOC_ERROR;
-                    strcpy(cb_ctx->cb_ret_msg,
-                           "Characteristic descriptor callback: Malloc "
-                           "error\n");
-                    goto exit;
-                }
-                bl_desc_list->data = bl_desc;
-            } else {
-                bl_desc_list = g_slist_append(bl_desc_list, bl_desc);
-            }
+            // Each request gathers its own descriptors, reversed at the end.
+            cb_ctx->list_cb = g_slist_prepend(cb_ctx->list_cb, bl_desc);
         } else {
             printf_dbg("Reach end of descriptor list\n");
             goto exit;
@@ -531,9 +1336,13 @@ void char_desc_cb(guint8 status, const guint8 *pdu, guint16 plen,
     }
     if ((handle != 0xffff) && (handle < cb_ctx->end_handle_cb)) {
         printf_dbg("[CB] OUT with asking for a new request\n");
-        if (gatt_discover_char_desc(cb_ctx->dev_ctx->attrib, handle + 1,
-                                    cb_ctx->end_handle_cb, char_desc_cb,
-                                    cb_ctx)) {
+        cb_ctx->start_handle_cb = handle + 1;
+        guint attrib_id = gatt_discover_char_desc(cb_ctx->dev_ctx->attrib,
+                                                  cb_ctx->start_handle_cb,
+                                                  cb_ctx->end_handle_cb,
+                                                  char_desc_cb, cb_ctx);
+        if (attrib_id) {
+            set_cb_attrib_id(cb_ctx, attrib_id);
             goto next;
         }
         cb_ctx->cb_ret_val = BL_SEND_REQUEST_ERROR;
@@ -541,23 +1350,43 @@ void char_desc_cb(guint8 status, const guint8 *pdu, guint16 plen,
     }
 
 exit:
-    if (bl_desc_list) {
+    if (cb_ctx->list_cb) {
         // Return what we got if we add something
         cb_ctx->cb_ret_val = BL_NO_ERROR;
-        cb_ctx->cb_ret_pointer = bl_desc_list;
+        cb_ctx->cb_ret_pointer = g_slist_reverse(cb_ctx->list_cb);
+        cb_ctx->cb_ret_free    = (GDestroyNotify) list_free;
+        cb_ctx->list_cb        = NULL;
     }
-    bl_desc_list = NULL;
-    g_mutex_unlock(&cb_ctx->pending_cb_mtx);
+    signal_cb(cb_ctx);
 next:
     if (list)
         att_data_list_free(list);
     printf_dbg("[CB] OUT char_desc_cb\n");
 }
 
+// Value of a response, referencing the receive buffer if the device allows
+// it, else copied.
+static bl_value_t *response_value_new(cb_ctx_t *cb_ctx, char *uuid_str,
+                                      uint16_t handle, const guint8 *pdu,
+                                      const uint8_t *value, size_t size)
+{
+    dev_ctx_t  *dev_ctx = cb_ctx->dev_ctx;
+    GBytes     *bytes   = NULL;
+    bl_value_t *bl_value;
+
+    if (dev_ctx && dev_ctx->opt_zero_copy)
+        bytes = g_attrib_ref_pdu(dev_ctx->attrib, pdu, value - pdu, size);
+    if (bytes == NULL)
+        return bl_value_new(uuid_str, handle, size, (uint8_t *) value);
+
+    bl_value = bl_value_new_from_bytes(uuid_str, handle, bytes);
+    g_bytes_unref(bytes);
+    return bl_value;
+}
+
 void read_by_hnd_cb(guint8 status, const guint8 *pdu, guint16 plen,
                     gpointer user_data)
 {
-    uint8_t   data[plen];
     ssize_t   vlen;
     cb_ctx_t *cb_ctx = user_data;
 
@@ -566,101 +1395,299 @@ void read_by_hnd_cb(guint8 status, const guint8 *pdu, guint16 plen,
         cb_ctx->cb_ret_val = BL_REQUEST_FAIL_ERROR;
         sprintf(cb_ctx->cb_ret_msg, "Read by handle callback: Failure: %s\n",
                 att_ecode2str(status));
-        goto error;
-    }
-
-    if (data == NULL) {
-        cb_ctx->cb_ret_val = BL_MALLOC_ERROR;
-        strcpy(cb_ctx->cb_ret_msg, "Read by handle callback: Malloc error\n");
-        goto error;
+        goto exit;
     }
 
-    vlen = dec_read_resp(pdu, plen, data, sizeof(data));
+    vlen = dec_read_resp(pdu, plen, NULL, 0);
     if (vlen < 0) {
         cb_ctx->cb_ret_val = BL_PROTOCOL_ERROR;
         strcpy(cb_ctx->cb_ret_msg,
                "Read by handle callback: Protocol error\n");
-        goto error;
+        goto exit;
     }
 
-    cb_ctx->cb_ret_pointer = bl_value_new(NULL, 0, vlen, data);
+    cb_ctx->cb_ret_pointer = response_value_new(cb_ctx, cb_ctx->uuid_cb,
+                                                cb_ctx->handle_cb, pdu,
+                                                pdu + 1, vlen);
     if (cb_ctx->cb_ret_pointer == NULL) {
         cb_ctx->cb_ret_val = BL_MALLOC_ERROR;
         strcpy(cb_ctx->cb_ret_msg, "Read by handle callback: Malloc error\n");
+        goto exit;
     }
 
-    cb_ctx->cb_ret_val = BL_NO_ERROR;
-    goto exit;
-
-error:
-    if (cb_ctx->cb_ret_pointer)
-        free(cb_ctx->cb_ret_pointer);
+    cb_ctx->cb_ret_free = (GDestroyNotify) bl_value_free;
+    cb_ctx->cb_ret_val  = BL_NO_ERROR;
 exit:
-    g_mutex_unlock(&cb_ctx->pending_cb_mtx);
+    signal_cb(cb_ctx);
     printf_dbg("[CB] OUT read_by_hnd_cb\n");
 }
 
+// Add a value of the Read Multiple response to the results, it is
+// truncated if the response is.
+static gboolean add_multi_value(cb_ctx_t *cb_ctx, int idx,
+                                const guint8 *pdu, const uint8_t *value,
+                                size_t size)
+{
+    bl_value_t *bl_value = response_value_new(cb_ctx, NULL,
+                                              cb_ctx->handles_cb[idx], pdu,
+                                              value, size);
+
+    if (bl_value == NULL)
+        return FALSE;
+
+    cb_ctx->list_cb = g_slist_prepend(cb_ctx->list_cb, bl_value);
+    return TRUE;
+}
+
+void read_multi_cb(guint8 status, const guint8 *pdu, guint16 plen,
+                   gpointer user_data)
+{
+    cb_ctx_t      *cb_ctx = user_data;
+    const uint8_t *value  = pdu + 1;
+    ssize_t        len;
+    int            done   = 0;
+
+    printf_dbg("[CB] IN read_multi_cb\n");
+    if (status) {
+        cb_ctx->cb_ret_val = BL_REQUEST_FAIL_ERROR;
+        sprintf(cb_ctx->cb_ret_msg, "Read multiple callback: Failure: %s\n",
+                att_ecode2str(status));
+        goto exit;
+    }
+
+    // A single handle is read with a Read Request
+    if (cb_ctx->batch_cb == 1)
+        len = dec_read_resp(pdu, plen, NULL, 0);
+    else
+        len = dec_read_multi_resp(pdu, plen, NULL, 0);
+    if (len < 0) {
+        cb_ctx->cb_ret_val = BL_PROTOCOL_ERROR;
+        strcpy(cb_ctx->cb_ret_msg,
+               "Read multiple callback: Protocol error\n");
+        goto exit;
+    }
+
+    while ((done < cb_ctx->batch_cb) &&
+           ((len > 0) || (cb_ctx->batch_cb == 1))) {
+        int    idx = cb_ctx->pos_cb + done;
+        size_t size;
+
+        if (cb_ctx->batch_cb == 1) {
+            size = len;
+        } else if (pdu[0] == ATT_OP_READ_MULTI_VL_RESP) {
+            if (len < 2)
+                break;
+            size = att_get_u16(value);
+            // Cut by the MTU: it is asked again, alone if it is the first.
+            if (size > (size_t) len - 2) {
+                cb_ctx->alone_cb = (done == 0);
+                break;
+            }
+            value += 2;
+            len   -= 2;
+        } else {
+            size = cb_ctx->sizes_cb[idx];
+            if (size > (size_t) len) {
+                cb_ctx->cb_ret_val = BL_PROTOCOL_ERROR;
+                sprintf(cb_ctx->cb_ret_msg, "Read multiple callback: Value "
+                        "of handle 0x%04x shorter than its size\n",
+                        cb_ctx->handles_cb[idx]);
+                goto exit;
+            }
+        }
+
+        if (!add_multi_value(cb_ctx, idx, pdu, value, size)) {
+            cb_ctx->cb_ret_val = BL_MALLOC_ERROR;
+            strcpy(cb_ctx->cb_ret_msg,
+                   "Read multiple callback: Malloc error\n");
+            goto exit;
+        }
+        value += size;
+        len   -= size;
+        done++;
+    }
+
+    if ((done == 0) && !cb_ctx->alone_cb) {
+        cb_ctx->cb_ret_val = BL_PROTOCOL_ERROR;
+        strcpy(cb_ctx->cb_ret_msg, "Read multiple callback: Empty response\n");
+        goto exit;
+    }
+    if (cb_ctx->batch_cb == 1)
+        cb_ctx->alone_cb = FALSE;
+    // The values missing from a truncated response are asked again.
+    cb_ctx->pos_cb += done;
+
+    if (cb_ctx->pos_cb < cb_ctx->nb_handles_cb) {
+        printf_dbg("[CB] OUT with asking for a new request\n");
+        guint attrib_id = cb_ctx->send_cb(cb_ctx->dev_ctx->attrib, cb_ctx);
+        if (attrib_id) {
+            set_cb_attrib_id(cb_ctx, attrib_id);
+            return;
+        }
+        cb_ctx->cb_ret_val = BL_SEND_REQUEST_ERROR;
+        strcpy(cb_ctx->cb_ret_msg, "Unable to send request\n");
+        goto exit;
+    }
+
+    cb_ctx->cb_ret_pointer = g_slist_reverse(cb_ctx->list_cb);
+    cb_ctx->cb_ret_free    = (GDestroyNotify) bl_value_list_free;
+    cb_ctx->cb_ret_val     = BL_NO_ERROR;
+    cb_ctx->list_cb        = NULL;
+exit:
+    signal_cb(cb_ctx);
+    printf_dbg("[CB] OUT read_multi_cb\n");
+}
+
+// Hand the values of a response over to the stream function of the request,
+// they are not gathered with the results.
+static void stream_values(cb_ctx_t *cb_ctx, GSList *bl_value_list)
+{
+    if (bl_future_poll(cb_ctx)) {
+        // Cancelled, nobody wants them anymore.
+        bl_value_list_free(bl_value_list);
+        return;
+    }
+    cb_ctx->stream_cb(cb_ctx->dev_ctx, cb_ctx->req_id,
+                      g_slist_reverse(bl_value_list),
+                      cb_ctx->async_user_data);
+}
+
 void read_by_uuid_cb(guint8 status, const guint8 *pdu, guint16 plen,
                      gpointer user_data)
 {
-    struct att_data_list *list;
+    struct att_data_list *list          = NULL;
     GSList               *bl_value_list = NULL;
-    cb_ctx_t             *cb_ctx = user_data;
+    uint16_t              handle        = 0xffff;
+    cb_ctx_t             *cb_ctx        = user_data;
 
     printf_dbg("[CB] IN read_by_uuid_cb\n");
     if (status) {
+        // Past the last match, what we got is the result.
+        if ((status == ATT_ECODE_ATTR_NOT_FOUND) && cb_ctx->nb_pdu_cb)
+            goto done;
         cb_ctx->cb_ret_val = BL_REQUEST_FAIL_ERROR;
         sprintf(cb_ctx->cb_ret_msg, "Read by uuid callback: Failure: %s\n",
                 att_ecode2str(status));
-        goto error;
+        goto exit;
     }
 
     list = dec_read_by_type_resp(pdu, plen);
     if (list == NULL) {
         strcpy(cb_ctx->cb_ret_msg, "Read by uuid callback: Nothing found\n");
-        cb_ctx->cb_ret_val = BL_NO_ERROR;
-        goto error;
+        goto done;
     }
+    cb_ctx->nb_pdu_cb++;
 
     for (int i = 0; i < list->num; i++) {
-        bl_value_t *bl_value = bl_value_new(NULL, att_get_u16(list->data[i]),
+        handle = att_get_u16(list->data[i]);
+        bl_value_t *bl_value = bl_value_new(cb_ctx->uuid_cb, handle,
                                             list->len - 2, list->data[i] + 2);
         if (bl_value == NULL) {
             cb_ctx->cb_ret_val = BL_MALLOC_ERROR;
             strcpy(cb_ctx->cb_ret_msg,
                    "Read by uuid callback: Malloc error\n");
-            goto error;
+            bl_value_list_free(bl_value_list);
+            goto exit;
         }
+        bl_value_list = g_slist_prepend(bl_value_list, bl_value);
+    }
 
-        // Add it to the value list
-        if (bl_value_list == NULL) {
-            bl_value_list = g_slist_alloc();
-            if (bl_value_list == NULL) {
-                cb_ctx->cb_ret_val = BL_MALLOC_ERROR;
-                strcpy(cb_ctx->cb_ret_msg,
-                       "Read by uuid callback: Malloc error\n");
-                goto error;
-            }
-            bl_value_list->data = bl_value;
-        } else {
-            bl_value_list = g_slist_append(bl_value_list, bl_value);
+    // Each request gathers its own values, reversed at the end.
+    if (cb_ctx->stream_cb)
+        stream_values(cb_ctx, bl_value_list);
+    else
+        cb_ctx->list_cb = g_slist_concat(bl_value_list, cb_ctx->list_cb);
+
+    // The response holds as many matches as the MTU allows, ask for the
+    // following ones.
+    if (handle < cb_ctx->end_handle_cb) {
+        printf_dbg("[CB] OUT with asking for a new request\n");
+        cb_ctx->start_handle_cb = handle + 1;
+        guint attrib_id = cb_ctx->send_cb(cb_ctx->dev_ctx->attrib, cb_ctx);
+        if (attrib_id) {
+            set_cb_attrib_id(cb_ctx, attrib_id);
+            goto next;
         }
+        cb_ctx->cb_ret_val = BL_SEND_REQUEST_ERROR;
+        strcpy(cb_ctx->cb_ret_msg, "Unable to send request\n");
+        goto exit;
     }
 
-    att_data_list_free(list);
-
-    cb_ctx->cb_ret_pointer = bl_value_list;
+done:
+    cb_ctx->cb_ret_pointer = g_slist_reverse(cb_ctx->list_cb);
+    cb_ctx->cb_ret_free    = (GDestroyNotify) bl_value_list_free;
     cb_ctx->cb_ret_val     = BL_NO_ERROR;
-    goto exit;
-
-error:
-    if (bl_value_list)
-        bl_value_list_free(bl_value_list);
+    cb_ctx->list_cb        = NULL;
 exit:
-    g_mutex_unlock(&cb_ctx->pending_cb_mtx);
+    signal_cb(cb_ctx);
+next:
+    if (list)
+        att_data_list_free(list);
     printf_dbg("[CB] OUT read_by_uuid_cb\n");
 }
 
+void read_long_cb(guint8 status, const guint8 *pdu, guint16 plen,
+                  gpointer user_data)
+{
+    cb_ctx_t *cb_ctx = user_data;
+    size_t    mtu;
+    size_t    len;
+
+    printf_dbg("[CB] IN read_long_cb\n");
+    if (status) {
+        // The value ended on the previous response.
+        if (((status == ATT_ECODE_INVALID_OFFSET) ||
+             (status == ATT_ECODE_ATTR_NOT_LONG)) && cb_ctx->offset_cb)
+            goto done;
+        cb_ctx->cb_ret_val = BL_REQUEST_FAIL_ERROR;
+        sprintf(cb_ctx->cb_ret_msg, "Read long callback: Failure: %s\n",
+                att_ecode2str(status));
+        goto exit;
+    }
+
+    if ((plen < 1) || ((pdu[0] != ATT_OP_READ_RESP) &&
+                       (pdu[0] != ATT_OP_READ_BLOB_RESP))) {
+        cb_ctx->cb_ret_val = BL_PROTOCOL_ERROR;
+        strcpy(cb_ctx->cb_ret_msg, "Read long callback: Protocol error\n");
+        goto exit;
+    }
+    len = plen - 1;
+
+    if (cb_ctx->chunk_cb) {
+        // Cancelled, nobody wants it anymore.
+        if (!bl_future_poll(cb_ctx))
+            cb_ctx->chunk_cb(cb_ctx->dev_ctx, cb_ctx->req_id,
+                             cb_ctx->offset_cb, pdu + 1, len,
+                             cb_ctx->async_user_data);
+    } else {
+        // The value is cut at the end of the buffer.
+        len = MIN(len, cb_ctx->buf_size_cb - cb_ctx->offset_cb);
+        memcpy(cb_ctx->buf_cb + cb_ctx->offset_cb, pdu + 1, len);
+    }
+    cb_ctx->offset_cb += len;
+
+    // A full response may be followed by more, ask for the next part.
+    g_attrib_get_buffer(cb_ctx->dev_ctx->attrib, &mtu);
+    if ((len == mtu - 1) && (cb_ctx->offset_cb <= 0xffff) &&
+        (cb_ctx->chunk_cb || (cb_ctx->offset_cb < cb_ctx->buf_size_cb))) {
+        printf_dbg("[CB] OUT with asking for a new request\n");
+        guint attrib_id = cb_ctx->send_cb(cb_ctx->dev_ctx->attrib, cb_ctx);
+        if (attrib_id) {
+            set_cb_attrib_id(cb_ctx, attrib_id);
+            return;
+        }
+        cb_ctx->cb_ret_val = BL_SEND_REQUEST_ERROR;
+        strcpy(cb_ctx->cb_ret_msg, "Unable to send request\n");
+        goto exit;
+    }
+
+done:
+    cb_ctx->cb_ret_val = BL_NO_ERROR;
+exit:
+    signal_cb(cb_ctx);
+    printf_dbg("[CB] OUT read_long_cb\n");
+}
+
 void write_req_cb(guint8 status, const guint8 *pdu, guint16 plen,
                   gpointer user_data)
 {
@@ -683,10 +1710,166 @@ void write_req_cb(guint8 status, const guint8 *pdu, guint16 plen,
     cb_ctx->cb_ret_val = BL_NO_ERROR;
     strcpy(cb_ctx->cb_ret_msg, "Write request callback: Success\n");
 end:
-    g_mutex_unlock(&cb_ctx->pending_cb_mtx);
+    signal_cb(cb_ctx);
     printf_dbg("[CB] OUT write_req_cb\n");
 }
 
+// Called once the write command has been given to the socket.
+void write_cmd_cb(gpointer user_data)
+{
+    cb_ctx_t *cb_ctx = user_data;
+
+    printf_dbg("[CB] IN write_cmd_cb\n");
+    cb_ctx->cb_ret_val = BL_NO_ERROR;
+    signal_cb(cb_ctx);
+    printf_dbg("[CB] OUT write_cmd_cb\n");
+}
+
+// Write command of a streaming write, queued on the GAttrib.
+typedef struct {
+    cb_ctx_t *cb_ctx;
+    guint     id;
+    size_t    size;
+} write_chunk_t;
+
+static void write_chunk_cb(gpointer user_data);
+
+void write_stream_free(write_stream_t *ws)
+{
+    if (ws->file)
+        g_mapped_file_unref(ws->file);
+    g_free(ws);
+}
+
+// Queue commands until the window is full or the source is exhausted.
+static guint queue_chunks(GAttrib *attrib, cb_ctx_t *cb_ctx)
+{
+    write_stream_t *ws = cb_ctx->wstream_cb;
+    uint8_t         value[ATT_MAX_VALUE_LEN];
+    size_t          mtu;
+    guint           id = 0;
+
+    g_attrib_get_buffer(attrib, &mtu);
+    mtu = MIN(mtu - 3, sizeof(value));
+
+    while (!ws->ended &&
+           (g_queue_get_length(&ws->chunks) < (guint) ws->window)) {
+        write_chunk_t *chunk;
+        ssize_t        size;
+
+        if (ws->src)
+            size = ws->src(value, mtu, ws->src_data);
+        else
+            size = MIN(ws->size - ws->pos, mtu);
+
+        if (size <= 0) {
+            ws->ended = TRUE;
+            if (size < 0) {
+                cb_ctx->cb_ret_val = BL_CANCELLED_ERROR;
+                strcpy(cb_ctx->cb_ret_msg,
+                       "Write stream: Aborted by the source\n");
+            }
+            break;
+        }
+
+        chunk = g_new0(write_chunk_t, 1);
+        chunk->cb_ctx = cb_ctx_ref(cb_ctx);
+        chunk->size   = MIN((size_t) size, mtu);
+        if (ws->src)
+            chunk->id = gatt_write_cmd(attrib, cb_ctx->handle_cb, value,
+                                       chunk->size, write_chunk_cb, chunk);
+        else if (ws->file)
+            // The mapping lives as long as the last command.
+            chunk->id = gatt_write_cmd_data(attrib, cb_ctx->handle_cb,
+                                            ws->data + ws->pos, chunk->size,
+                                            write_chunk_cb, chunk);
+        else
+            chunk->id = gatt_write_cmd(attrib, cb_ctx->handle_cb,
+                                       (uint8_t *) ws->data + ws->pos,
+                                       chunk->size, write_chunk_cb, chunk);
+        if (chunk->id == 0) {
+            cb_ctx_unref(cb_ctx);
+            g_free(chunk);
+            ws->ended = TRUE;
+            cb_ctx->cb_ret_val = BL_SEND_REQUEST_ERROR;
+            strcpy(cb_ctx->cb_ret_msg,
+                   "Write stream: Unable to send command\n");
+            break;
+        }
+        g_queue_push_tail(&ws->chunks, chunk);
+        ws->pos += chunk->size;
+        id = chunk->id;
+    }
+    return id;
+}
+
+guint write_stream_send(GAttrib *attrib, cb_ctx_t *cb_ctx)
+{
+    guint id;
+
+    cb_ctx->wstream_cb->start_time = g_get_monotonic_time();
+    id = queue_chunks(attrib, cb_ctx);
+    // Empty stream or error: the request ends right away, the queue
+    // reference is released by our caller.
+    if (id == 0)
+        signal_cb(cb_ctx_ref(cb_ctx));
+    return id;
+}
+
+// Called once a command has been given to the socket, or dropped.
+// Each command holds a reference on the context, the request ends with the
+// last one.
+static void write_chunk_cb(gpointer user_data)
+{
+    write_chunk_t  *chunk  = user_data;
+    cb_ctx_t       *cb_ctx = chunk->cb_ctx;
+    write_stream_t *ws     = cb_ctx->wstream_cb;
+    GAttrib        *attrib = cb_ctx->dev_ctx->attrib;
+    write_chunk_t  *next;
+    gint64          elapsed;
+
+    // Already dropped along with the other ones, see below.
+    if (!g_queue_remove(&ws->chunks, chunk))
+        goto free;
+
+    if (bl_future_poll(cb_ctx)) {
+        // Cancelled or timed out: drop the commands still queued.
+        ws->ended = TRUE;
+        while ((next = g_queue_pop_head(&ws->chunks)))
+            g_attrib_cancel(attrib, next->id);
+        goto end;
+    }
+
+    ws->written += chunk->size;
+    if (ws->progress) {
+        elapsed = MAX(g_get_monotonic_time() - ws->start_time, 1);
+        ws->progress(cb_ctx->dev_ctx, cb_ctx->req_id, ws->written,
+                     ws->written * 1000000.0 / elapsed, ws->progress_data);
+    }
+    set_cb_timeout(cb_ctx, cb_ctx->dev_ctx->opt_timeout_ms);
+
+    if (attrib == NULL) {
+        // Disconnected, the GAttrib is being destroyed.
+        if (!ws->ended) {
+            ws->ended = TRUE;
+            cb_ctx->cb_ret_val = BL_DISCONNECTED_ERROR;
+            strcpy(cb_ctx->cb_ret_msg, "Write stream: Disconnected\n");
+        }
+    } else {
+        guint id = queue_chunks(attrib, cb_ctx);
+
+        if (id)
+            set_cb_attrib_id(cb_ctx, id);
+    }
+
+end:
+    if (g_queue_is_empty(&ws->chunks))
+        signal_cb(cb_ctx);
+free:
+    g_free(chunk);
+    cb_ctx_unref(cb_ctx);
+}
+
 void exchange_mtu_cb(guint8 status, const guint8 *pdu, guint16 plen,
                      gpointer user_data)
 {
@@ -721,6 +1904,6 @@ void exchange_mtu_cb(guint8 status, const guint8 *pdu, guint16 plen,
         cb_ctx->cb_ret_val = BL_NO_ERROR;
     }
 error:
-    g_mutex_unlock(&cb_ctx->pending_cb_mtx);
+    signal_cb(cb_ctx);
     printf_dbg("[CB] OUT exchange_mtu_cb\n");
 }
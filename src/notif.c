@@ -28,14 +28,177 @@
 #include "uuid.h"
 #include "att.h"
 #include "gatt_def.h"
+#include "callback.h"
 
 #define printf(...) printf("[NOTIF] " __VA_ARGS__)
 
+// Keeps the producer and the consumer indexes on their own cache lines.
+#define CACHE_LINE_SIZE 64
+
+// Notifications taken at most by each move of the head of a ring.
+#define POP_BATCH 64
+
+// Key of the batch callback in the notification list.
+#define NOTIF_BATCH_KEY "notify-multi"
+
+// Arguments of a change of the GAttrib events, which is made from the event
+// loop of the device while it dispatches the notifications, see run_in_loop.
+typedef struct {
+    uint8_t            opcode;
+    char              *uuid_str;   // NULL to find it from handle.
+    uint16_t           handle;
+    GAttribNotifyFunc  func;
+    void              *user_data;
+    GDestroyNotify     notify;
+    gboolean           replace;    // Unregister uuid_str first.
+    gboolean           confirm;    // Auto-confirm the indications.
+    char              *found;      // UUID found from handle.
+} event_call_t;
+
+// Callback of bl_add_notif_batch.
+typedef struct {
+    dev_ctx_t           *dev_ctx;
+    bl_notif_batch_cb_t  func;
+    void                *user_data;
+} batch_sub_t;
+
+// A value handle of a device, the key of the subscriptions of a ring.
+typedef struct {
+    dev_ctx_t *dev_ctx;
+    uint16_t   handle;
+} sub_key_t;
+
+// Subscription pushing to a ring.
+typedef struct {
+    gint             refs;    // Registration and tokens in the ring.
+    sub_key_t        key;
+    bl_notif_ring_t *ring;
+    bl_overflow_t    policy;
+    bl_notif_stats_t stats;   // Updated atomically.
+    gboolean         removed; // Unregistered, under the mutex of the ring.
+    // BL_OVERFLOW_KEEP_LATEST: newest value not popped yet, whether a
+    // token pointing to it is in the ring, and whether the ring was full
+    // when it came: the consumer then takes it without token.
+    bl_notif_t      *latest;
+    gint             queued;
+    gint             stalled;
+} ring_sub_t;
+
+// A notification, or a token to take the latest value of sub.
+typedef struct {
+    bl_notif_t  notif;
+    ring_sub_t *sub;
+} ring_slot_t;
+
+// The consumer and the producer both move head, to drop the oldest
+// notifications, with a compare and exchange.
+struct bl_notif_ring {
+    guint       mask;
+    gint        dropped;
+    GMutex      mtx;       // Protects subs, and waiting with cond.
+    GCond       cond;
+    GHashTable *subs;      // sub_key_t -> ring_sub_t
+    gint        waiting;   // The producer waits for room.
+    gint        stalled;   // Subscriptions with their stalled flag set.
+    char        pad0[CACHE_LINE_SIZE];
+    gint        head;      // Next notification popped.
+    char        pad1[CACHE_LINE_SIZE];
+    gint        tail;      // Next notification pushed, set by the producer.
+    char        pad2[CACHE_LINE_SIZE];
+    ring_slot_t slots[];
+};
+
+static int add_notif(dev_ctx_t *dev_ctx, bl_char_t *start_bl_char,
+                     bl_char_t *end_bl_char, bl_primary_t *bl_primary,
+                     GAttribNotifyFunc func, void *user_data,
+                     GDestroyNotify notify, uint8_t opcode,
+                     gboolean confirm, gboolean replace);
+
+static int register_loop(dev_ctx_t *dev_ctx, void *data)
+{
+    event_call_t *call = data;
+
+    if (!dev_ctx->attrib)
+        return BL_DISCONNECTED_ERROR;
+
+    if (call->replace && has_event_by_uuid(dev_ctx->attrib, call->uuid_str))
+        g_attrib_unregister(dev_ctx->attrib, call->uuid_str);
+
+    if (!g_attrib_register(dev_ctx->attrib, call->opcode, call->uuid_str,
+                           call->handle, call->func, call->user_data,
+                           call->notify))
+        return BL_MALLOC_ERROR;
+
+    // Before the first indication can be dispatched.
+    if (call->confirm)
+        g_attrib_set_auto_confirm(dev_ctx->attrib, call->uuid_str, TRUE);
+    return BL_NO_ERROR;
+}
+
+// Returns ENOENT if nothing is registered for the UUID.
+static int unregister_loop(dev_ctx_t *dev_ctx, void *data)
+{
+    event_call_t *call     = data;
+    char         *uuid_str = call->uuid_str;
+
+    if (!dev_ctx->attrib)
+        return BL_DISCONNECTED_ERROR;
+
+    if (uuid_str == NULL)
+        uuid_str = event_get_uuid_by_handle(dev_ctx->attrib, call->handle);
+    if ((uuid_str == NULL) || !g_attrib_unregister(dev_ctx->attrib, uuid_str))
+        return ENOENT;
+    return BL_NO_ERROR;
+}
+
+static int unregister_all_loop(dev_ctx_t *dev_ctx, void *data)
+{
+    if (!dev_ctx->attrib)
+        return BL_DISCONNECTED_ERROR;
+
+    g_attrib_unregister_all(dev_ctx->attrib);
+    return BL_NO_ERROR;
+}
+
+static int auto_confirm_loop(dev_ctx_t *dev_ctx, void *data)
+{
+    event_call_t *call = data;
+
+    if (!dev_ctx->attrib)
+        return BL_DISCONNECTED_ERROR;
+
+    if (!g_attrib_set_auto_confirm(dev_ctx->attrib, call->uuid_str,
+                                   call->confirm))
+        return ENOENT;
+    return BL_NO_ERROR;
+}
+
+static int get_uuid_loop(dev_ctx_t *dev_ctx, void *data)
+{
+    event_call_t *call = data;
+
+    if (!dev_ctx->attrib)
+        return BL_DISCONNECTED_ERROR;
+
+    call->found = event_get_uuid_by_handle(dev_ctx->attrib, call->handle);
+    return BL_NO_ERROR;
+}
+
+static int list_print_loop(dev_ctx_t *dev_ctx, void *data)
+{
+    if (!dev_ctx->attrib)
+        return BL_DISCONNECTED_ERROR;
+
+    event_list_print(dev_ctx->attrib);
+    return BL_NO_ERROR;
+}
+
 // Add a notification by UUID.
 int bl_add_notif(dev_ctx_t *dev_ctx, char *uuid_str, bl_primary_t *bl_primary,
                  GAttribNotifyFunc func, void *user_data, uint8_t opcode)
 {
-    GError *gerr = NULL;
+    GError       *gerr = NULL;
+    event_call_t  call = { .uuid_str = uuid_str };
 
     // Get the characteristic associated to the UUID
     bl_char_t *bl_char = bl_get_char(dev_ctx, uuid_str, bl_primary, &gerr);
@@ -45,10 +208,8 @@ int bl_add_notif(dev_ctx_t *dev_ctx, char *uuid_str, bl_primary_t *bl_primary,
         return gerr->code;
     }
 
-    if (has_event_by_uuid(dev_ctx->attrib, uuid_str)) {
+    if (run_in_loop(dev_ctx, unregister_loop, &call) == BL_NO_ERROR)
         printf("Notification substitute\n");
-        g_attrib_unregister(dev_ctx->attrib, uuid_str);
-    }
     int ret = bl_add_notif_by_char(dev_ctx, bl_char, NULL, bl_primary, func,
                                    user_data, opcode);
     bl_char_free(bl_char);
@@ -62,10 +223,26 @@ int bl_add_notif_by_char(dev_ctx_t *dev_ctx, bl_char_t *start_bl_char,
                          bl_char_t *end_bl_char, bl_primary_t *bl_primary,
                          GAttribNotifyFunc func, void *user_data,
                          uint8_t opcode)
+{
+    return add_notif(dev_ctx, start_bl_char, end_bl_char, bl_primary, func,
+                     dev_ctx->attrib, (GDestroyNotify) user_data, opcode,
+                     FALSE, FALSE);
+}
+
+// Enable the notification or indication on the device, then call func with
+// user_data at each one until notify is called. With confirm, the
+// indications are acknowledged on arrival. With replace, what is registered
+// for the characteristic is unregistered first.
+static int add_notif(dev_ctx_t *dev_ctx, bl_char_t *start_bl_char,
+                     bl_char_t *end_bl_char, bl_primary_t *bl_primary,
+                     GAttribNotifyFunc func, void *user_data,
+                     GDestroyNotify notify, uint8_t opcode,
+                     gboolean confirm, gboolean replace)
 {
     GError *gerr = NULL;
     uint8_t value;
     bl_desc_t *client_char_conf = NULL;
+    int ret;
     if (gerr)
         goto gerror;
 
@@ -95,16 +272,24 @@ int bl_add_notif_by_char(dev_ctx_t *dev_ctx, bl_char_t *start_bl_char,
     if (bl_write_desc_by_desc(dev_ctx, client_char_conf, &value, 2))
         goto error;
 
-    if (!g_attrib_register(dev_ctx->attrib, opcode, start_bl_char->uuid_str,
-                           start_bl_char->value_handle, func, dev_ctx->attrib,
-                           user_data)) {
+    event_call_t call = {
+        .opcode    = opcode,
+        .uuid_str  = start_bl_char->uuid_str,
+        .handle    = start_bl_char->value_handle,
+        .func      = func,
+        .user_data = user_data,
+        .notify    = notify,
+        .replace   = replace,
+        .confirm   = confirm,
+    };
+
+    ret = run_in_loop(dev_ctx, register_loop, &call);
+    if (ret == BL_MALLOC_ERROR)
         printf("Malloc error");
-        return BL_MALLOC_ERROR;
-    }
 
     if (client_char_conf)
         bl_desc_free(client_char_conf);
-    return BL_NO_ERROR;
+    return ret;
 
 error:
     if (client_char_conf)
@@ -124,55 +309,545 @@ gerror:
 // Retrieve a UUID from a handle.
 char *bl_get_notif_uuid(dev_ctx_t *dev_ctx, uint16_t handle)
 {
-    return event_get_uuid_by_handle(dev_ctx->attrib, handle);
+    event_call_t call = { .handle = handle };
+
+    run_in_loop(dev_ctx, get_uuid_loop, &call);
+    return call.found;
 }
 
 // Remove a notification by UUID.
 int bl_remove_notif(dev_ctx_t *dev_ctx, char *uuid_str)
 {
-    if (!dev_ctx->attrib)
-        return BL_DISCONNECTED_ERROR;
+    event_call_t call = { .uuid_str = uuid_str };
+    int          ret  = run_in_loop(dev_ctx, unregister_loop, &call);
 
-    g_attrib_unregister(dev_ctx->attrib, uuid_str);
-    return BL_NO_ERROR;
+    return (ret == ENOENT) ? BL_NO_ERROR : ret;
 }
 
 // Remove a notification by characteristic.
 int bl_remove_notif_by_char(dev_ctx_t *dev_ctx, bl_char_t *bl_char)
 {
-    if (!dev_ctx->attrib)
-        return BL_DISCONNECTED_ERROR;
+    event_call_t call = { .handle = bl_char->handle };
+    int          ret  = run_in_loop(dev_ctx, unregister_loop, &call);
 
-    char *uuid_str = bl_get_notif_uuid(dev_ctx, bl_char->handle);
-
-    g_attrib_unregister(dev_ctx->attrib, uuid_str);
-    return BL_NO_ERROR;
+    return (ret == ENOENT) ? BL_NO_ERROR : ret;
 }
 
 // Remove all notification registered.
 int bl_remove_all_notif(dev_ctx_t *dev_ctx)
 {
-    if (!dev_ctx->attrib)
-        return BL_DISCONNECTED_ERROR;
-
-    g_attrib_unregister_all(dev_ctx->attrib);
-    return BL_NO_ERROR;
+    return run_in_loop(dev_ctx, unregister_all_loop, NULL);
 }
 
 // Print the notification list currently registered.
 void bl_notif_list_print(dev_ctx_t *dev_ctx)
 {
-    event_list_print(dev_ctx->attrib);
+    run_in_loop(dev_ctx, list_print_loop, NULL);
 }
 
-void bl_notif_indication_resp(dev_ctx_t *dev_ctx)
+static int indication_resp_loop(dev_ctx_t *dev_ctx, void *data)
 {
     int16_t  olen;
     uint8_t *opdu;
     size_t   plen;
+
+    if (!dev_ctx->attrib)
+        return BL_DISCONNECTED_ERROR;
+
     opdu = g_attrib_get_buffer(dev_ctx->attrib, &plen);
     olen = enc_confirmation(opdu, plen);
 
     if (olen > 0)
         g_attrib_send(dev_ctx->attrib, 0, opdu, olen, NULL, NULL, NULL);
+    return BL_NO_ERROR;
+}
+
+// The confirmation is sent from the event loop, like the requests.
+void bl_notif_indication_resp(dev_ctx_t *dev_ctx)
+{
+    run_in_loop(dev_ctx, indication_resp_loop, NULL);
+}
+
+int bl_notif_set_auto_confirm(dev_ctx_t *dev_ctx, char *uuid_str,
+                              gboolean enable)
+{
+    event_call_t call = { .uuid_str = uuid_str, .confirm = enable };
+
+    return run_in_loop(dev_ctx, auto_confirm_loop, &call);
+}
+
+int bl_enable_notif_multi(dev_ctx_t *dev_ctx)
+{
+    GError     *gerr     = NULL;
+    bl_value_t *bl_value = bl_read_char(dev_ctx,
+                                        GATT_CHARAC_CLIENT_SUPP_FEAT_STR,
+                                        NULL, &gerr);
+    int         ret;
+
+    if (gerr) {
+        printf("%s\n", gerr->message);
+        ret = gerr->code;
+        g_error_free(gerr);
+        return ret;
+    }
+
+    if ((bl_value == NULL) || (bl_value->data_size == 0)) {
+        bl_value_free(bl_value);
+        return BL_PROTOCOL_ERROR;
+    }
+
+    // The other features are kept.
+    bl_value->data[0] |= GATT_CLIENT_SUPP_FEAT_MULTI_NOTIF_BIT;
+    ret = bl_write_char(dev_ctx, GATT_CHARAC_CLIENT_SUPP_FEAT_STR, NULL,
+                        bl_value->data, bl_value->data_size, WRITE_REQ);
+    bl_value_free(bl_value);
+    return ret;
+}
+
+static void batch_notif_cb(const guint8 *pdu, guint16 len, gpointer user_data)
+{
+    batch_sub_t     *sub = user_data;
+    bl_notif_item_t  items[len / 4 + 1];
+    int              nb  = 0;
+    ssize_t          next;
+
+    for (size_t offset = 1; offset < len; offset = next) {
+        uint16_t vlen;
+
+        next = dec_notify_multi(pdu, len, offset, &items[nb].handle,
+                                &items[nb].data, &vlen);
+        if (next < 0)
+            break;
+        items[nb++].size = vlen;
+    }
+
+    if (nb)
+        sub->func(sub->dev_ctx, items, nb, sub->user_data);
+}
+
+int bl_add_notif_batch(dev_ctx_t *dev_ctx, bl_notif_batch_cb_t func,
+                       void *user_data)
+{
+    batch_sub_t *sub;
+    int          ret;
+
+    if (func == NULL)
+        return EINVAL;
+
+    sub = g_try_new(batch_sub_t, 1);
+    if (sub == NULL)
+        return BL_MALLOC_ERROR;
+
+    sub->dev_ctx   = dev_ctx;
+    sub->func      = func;
+    sub->user_data = user_data;
+
+    event_call_t call = {
+        .opcode    = ATT_OP_HANDLE_NOTIFY_MULTI,
+        .uuid_str  = NOTIF_BATCH_KEY,
+        .handle    = GATTRIB_ALL_HANDLES,
+        .func      = batch_notif_cb,
+        .user_data = sub,
+        .notify    = g_free,
+        .replace   = TRUE,
+    };
+
+    ret = run_in_loop(dev_ctx, register_loop, &call);
+    if (ret) {
+        g_free(sub);
+        if (ret == BL_MALLOC_ERROR)
+            printf("Malloc error");
+    }
+    return ret;
+}
+
+int bl_remove_notif_batch(dev_ctx_t *dev_ctx)
+{
+    event_call_t call = { .uuid_str = NOTIF_BATCH_KEY };
+    int          ret  = run_in_loop(dev_ctx, unregister_loop, &call);
+
+    return (ret == ENOENT) ? BL_NO_ERROR : ret;
+}
+
+GBytes *bl_notif_value_ref(dev_ctx_t *dev_ctx, const uint8_t *pdu,
+                           uint16_t len)
+{
+    GBytes *bytes = NULL;
+
+    if (len < NOTIF_PDU_HEADER_SIZE)
+        return NULL;
+
+    if (dev_ctx->opt_zero_copy)
+        bytes = g_attrib_ref_pdu(dev_ctx->attrib, pdu, NOTIF_PDU_HEADER_SIZE,
+                                 len - NOTIF_PDU_HEADER_SIZE);
+    if (bytes == NULL)
+        bytes = g_bytes_new(pdu + NOTIF_PDU_HEADER_SIZE,
+                            len - NOTIF_PDU_HEADER_SIZE);
+    return bytes;
+}
+
+static guint sub_key_hash(gconstpointer key)
+{
+    const sub_key_t *sub_key = key;
+
+    return g_direct_hash(sub_key->dev_ctx) ^ sub_key->handle;
+}
+
+static gboolean sub_key_equal(gconstpointer a, gconstpointer b)
+{
+    const sub_key_t *key_a = a;
+    const sub_key_t *key_b = b;
+
+    return (key_a->dev_ctx == key_b->dev_ctx) &&
+           (key_a->handle == key_b->handle);
+}
+
+bl_notif_ring_t *bl_notif_ring_new(size_t capacity)
+{
+    bl_notif_ring_t *ring;
+    size_t           size = 1;
+
+    if ((capacity == 0) || (capacity > G_MAXINT / 2))
+        return NULL;
+
+    while (size < capacity)
+        size <<= 1;
+
+    ring = g_try_malloc0(sizeof(*ring) + size * sizeof(ring_slot_t));
+    if (ring == NULL)
+        return NULL;
+
+    ring->mask = size - 1;
+    g_mutex_init(&ring->mtx);
+    g_cond_init(&ring->cond);
+    ring->subs = g_hash_table_new(sub_key_hash, sub_key_equal);
+    return ring;
+}
+
+static void ring_slot_release(bl_notif_ring_t *ring, ring_slot_t *slot);
+
+void bl_notif_ring_free(bl_notif_ring_t *ring)
+{
+    if (ring == NULL)
+        return;
+
+    // Nobody pushes anymore. The tokens whose value was already taken are
+    // released too, the last one frees its subscription.
+    for (guint i = ring->head; i != (guint) ring->tail; i++)
+        ring_slot_release(ring, &ring->slots[i & ring->mask]);
+    g_hash_table_destroy(ring->subs);
+    g_cond_clear(&ring->cond);
+    g_mutex_clear(&ring->mtx);
+    g_free(ring);
+}
+
+static ring_sub_t *ring_sub_ref(ring_sub_t *sub)
+{
+    g_atomic_int_inc(&sub->refs);
+    return sub;
+}
+
+static void ring_sub_unref(ring_sub_t *sub)
+{
+    if (!g_atomic_int_dec_and_test(&sub->refs))
+        return;
+
+    if (sub->latest) {
+        g_bytes_unref(sub->latest->value);
+        g_free(sub->latest);
+    }
+    g_free(sub);
+}
+
+// Destroy notify of the registration.
+static void ring_sub_remove(gpointer user_data)
+{
+    ring_sub_t      *sub  = user_data;
+    bl_notif_ring_t *ring = sub->ring;
+
+    g_mutex_lock(&ring->mtx);
+    sub->removed = TRUE;
+    if (g_hash_table_lookup(ring->subs, &sub->key) == sub)
+        g_hash_table_remove(ring->subs, &sub->key);
+    if (g_atomic_int_compare_and_exchange(&sub->stalled, 1, 0))
+        g_atomic_int_add(&ring->stalled, -1);
+    g_mutex_unlock(&ring->mtx);
+    ring_sub_unref(sub);
+}
+
+// Exchange the latest value of sub, lock-free.
+static bl_notif_t *ring_sub_swap_latest(ring_sub_t *sub, bl_notif_t *notif)
+{
+    bl_notif_t *old;
+
+    do {
+        old = g_atomic_pointer_get(&sub->latest);
+    } while (!g_atomic_pointer_compare_and_exchange(&sub->latest, old,
+                                                    notif));
+    return old;
+}
+
+// Release a slot that will never be popped. The latest value of a token
+// is then taken by the consumer without it, see ring_take_stalled.
+static void ring_slot_release(bl_notif_ring_t *ring, ring_slot_t *slot)
+{
+    ring_sub_t *sub = slot->sub;
+
+    if (sub) {
+        g_atomic_int_set(&sub->queued, 0);
+        g_mutex_lock(&ring->mtx);
+        if (!sub->removed &&
+            g_atomic_int_compare_and_exchange(&sub->stalled, 0, 1))
+            g_atomic_int_inc(&ring->stalled);
+        g_mutex_unlock(&ring->mtx);
+        ring_sub_unref(sub);
+    } else {
+        g_bytes_unref(slot->notif.value);
+    }
+}
+
+// Make room for a notification of sub at tail according to its policy,
+// returns FALSE if it is dropped.
+static gboolean ring_reserve(bl_notif_ring_t *ring, ring_sub_t *sub,
+                             guint tail)
+{
+    for (;;) {
+        guint       head = g_atomic_int_get(&ring->head);
+        ring_slot_t oldest;
+
+        if (tail - head <= ring->mask)
+            return TRUE;
+
+        switch (sub->policy) {
+        case BL_OVERFLOW_DROP_OLDEST:
+            oldest = ring->slots[head & ring->mask];
+            if (!g_atomic_int_compare_and_exchange(&ring->head, head,
+                                                   head + 1))
+                break;
+            ring_slot_release(ring, &oldest);
+            g_atomic_int_inc(&ring->dropped);
+            g_atomic_int_inc((gint *) &sub->stats.dropped);
+            break;
+
+        case BL_OVERFLOW_BLOCK:
+            g_atomic_int_inc((gint *) &sub->stats.blocked);
+            g_mutex_lock(&ring->mtx);
+            g_atomic_int_set(&ring->waiting, 1);
+            while (tail - (guint) g_atomic_int_get(&ring->head) > ring->mask)
+                g_cond_wait(&ring->cond, &ring->mtx);
+            g_atomic_int_set(&ring->waiting, 0);
+            g_mutex_unlock(&ring->mtx);
+            break;
+
+        case BL_OVERFLOW_KEEP_LATEST:
+            // The value waits for the consumer, see ring_take_stalled.
+            if (g_atomic_int_compare_and_exchange(&sub->stalled, 0, 1))
+                g_atomic_int_inc(&ring->stalled);
+            return FALSE;
+
+        default:
+            g_atomic_int_inc(&ring->dropped);
+            g_atomic_int_inc((gint *) &sub->stats.dropped);
+            return FALSE;
+        }
+    }
+}
+
+// Runs on the event loop, the only producer of the ring.
+static void ring_notif_cb(const guint8 *pdu, guint16 len, gpointer user_data)
+{
+    ring_sub_t      *sub  = user_data;
+    bl_notif_ring_t *ring = sub->ring;
+    guint            tail = ring->tail;
+    ring_slot_t     *slot;
+    bl_notif_t       notif;
+    bl_notif_t      *latest;
+
+    if (len < NOTIF_PDU_HEADER_SIZE)
+        return;
+
+    g_atomic_int_inc((gint *) &sub->stats.received);
+
+    notif.dev_ctx   = sub->key.dev_ctx;
+    notif.handle    = att_get_u16(&pdu[1]);
+    notif.timestamp = g_get_monotonic_time();
+    notif.value     = bl_notif_value_ref(sub->key.dev_ctx, pdu, len);
+    if (notif.value == NULL)
+        return;
+
+    // The newest value replaces the one not popped yet, a token to take it
+    // is only pushed if none is in the ring.
+    if (sub->policy == BL_OVERFLOW_KEEP_LATEST) {
+        latest  = g_new(bl_notif_t, 1);
+        *latest = notif;
+        latest  = ring_sub_swap_latest(sub, latest);
+        if (latest) {
+            g_atomic_int_inc((gint *) &sub->stats.conflated);
+            g_bytes_unref(latest->value);
+            g_free(latest);
+        }
+        if (g_atomic_int_get(&sub->queued) || !ring_reserve(ring, sub, tail))
+            return;
+
+        g_atomic_int_set(&sub->queued, 1);
+        slot      = &ring->slots[tail & ring->mask];
+        slot->sub = ring_sub_ref(sub);
+    } else {
+        if (!ring_reserve(ring, sub, tail)) {
+            g_bytes_unref(notif.value);
+            return;
+        }
+        slot        = &ring->slots[tail & ring->mask];
+        slot->notif = notif;
+        slot->sub   = NULL;
+    }
+
+    // Publishes the notification to the consumer.
+    g_atomic_int_set(&ring->tail, tail + 1);
+}
+
+int bl_add_notif_ring(dev_ctx_t *dev_ctx, bl_char_t *start_bl_char,
+                      bl_char_t *end_bl_char, bl_primary_t *bl_primary,
+                      bl_notif_ring_t *ring, bl_overflow_t policy,
+                      uint8_t opcode)
+{
+    ring_sub_t *sub;
+    int         ret;
+
+    if ((ring == NULL) || (start_bl_char == NULL) ||
+        (policy > BL_OVERFLOW_KEEP_LATEST))
+        return EINVAL;
+
+    sub = g_try_new0(ring_sub_t, 1);
+    if (sub == NULL)
+        return BL_MALLOC_ERROR;
+
+    sub->refs    = 1;
+    sub->key.dev_ctx = dev_ctx;
+    sub->key.handle  = start_bl_char->value_handle;
+    sub->ring        = ring;
+    sub->policy      = policy;
+
+    // A previous subscription on the handle is unregistered, which removes
+    // it from its ring, so that each value is pushed once. It stays in the
+    // table if this one fails.
+    ret = add_notif(dev_ctx, start_bl_char, end_bl_char, bl_primary,
+                    ring_notif_cb, ring_sub_ref(sub), ring_sub_remove, opcode,
+                    opcode == ATT_OP_HANDLE_IND, TRUE);
+    if (ret) {
+        ring_sub_unref(sub);
+        ring_sub_unref(sub);
+        return ret;
+    }
+
+    // Unless unregistered meanwhile. The key of a replaced subscription goes
+    // away with it.
+    g_mutex_lock(&ring->mtx);
+    if (!sub->removed)
+        g_hash_table_replace(ring->subs, &sub->key, sub);
+    g_mutex_unlock(&ring->mtx);
+    ring_sub_unref(sub);
+    return BL_NO_ERROR;
+}
+
+// Move the latest values that found the ring full to notifs, once the ring
+// is drained, so that they are not stuck until their handle notifies again.
+static size_t ring_take_stalled(bl_notif_ring_t *ring, bl_notif_t *notifs,
+                                size_t max)
+{
+    GHashTableIter iter;
+    gpointer       value;
+    size_t         ret = 0;
+
+    g_mutex_lock(&ring->mtx);
+    g_hash_table_iter_init(&iter, ring->subs);
+    while ((ret < max) && g_atomic_int_get(&ring->stalled) &&
+           g_hash_table_iter_next(&iter, NULL, &value)) {
+        ring_sub_t *sub = value;
+        bl_notif_t *latest;
+
+        if (!g_atomic_int_compare_and_exchange(&sub->stalled, 1, 0))
+            continue;
+        g_atomic_int_add(&ring->stalled, -1);
+
+        // A token pushed meanwhile finds no value and is skipped.
+        latest = ring_sub_swap_latest(sub, NULL);
+        if (latest) {
+            notifs[ret++] = *latest;
+            g_free(latest);
+        }
+    }
+    g_mutex_unlock(&ring->mtx);
+    return ret;
+}
+
+size_t bl_notif_ring_pop(bl_notif_ring_t *ring, bl_notif_t *notifs,
+                         size_t max)
+{
+    ring_slot_t slots[MIN(max, POP_BATCH) + 1];
+    size_t      nb;
+    size_t      ret = 0;
+    guint       head;
+
+    // The slots are only ours once head is moved past them.
+    do {
+        head = g_atomic_int_get(&ring->head);
+        nb   = (guint) g_atomic_int_get(&ring->tail) - head;
+        nb   = MIN(nb, MIN(max, POP_BATCH));
+        for (size_t i = 0; i < nb; i++)
+            slots[i] = ring->slots[(head + i) & ring->mask];
+    } while (nb && !g_atomic_int_compare_and_exchange(&ring->head, head,
+                                                      head + nb));
+
+    if (nb && g_atomic_int_get(&ring->waiting)) {
+        g_mutex_lock(&ring->mtx);
+        g_cond_signal(&ring->cond);
+        g_mutex_unlock(&ring->mtx);
+    }
+
+    for (size_t i = 0; i < nb; i++) {
+        ring_sub_t *sub = slots[i].sub;
+        bl_notif_t *latest;
+
+        if (sub == NULL) {
+            notifs[ret++] = slots[i].notif;
+            continue;
+        }
+
+        // The next value needs a new token.
+        g_atomic_int_set(&sub->queued, 0);
+        latest = ring_sub_swap_latest(sub, NULL);
+        if (latest) {
+            notifs[ret++] = *latest;
+            g_free(latest);
+        }
+        ring_sub_unref(sub);
+    }
+
+    if ((nb < MIN(max, POP_BATCH)) && g_atomic_int_get(&ring->stalled))
+        ret += ring_take_stalled(ring, notifs + ret, max - ret);
+    return ret;
+}
+
+unsigned int bl_notif_ring_dropped(bl_notif_ring_t *ring)
+{
+    return g_atomic_int_get(&ring->dropped);
+}
+
+int bl_notif_ring_get_stats(bl_notif_ring_t *ring, dev_ctx_t *dev_ctx,
+                            uint16_t handle, bl_notif_stats_t *stats)
+{
+    sub_key_t   key = { .dev_ctx = dev_ctx, .handle = handle };
+    ring_sub_t *sub;
+
+    g_mutex_lock(&ring->mtx);
+    sub = g_hash_table_lookup(ring->subs, &key);
+    if (sub) {
+        stats->received  = g_atomic_int_get((gint *) &sub->stats.received);
+        stats->dropped   = g_atomic_int_get((gint *) &sub->stats.dropped);
+        stats->conflated = g_atomic_int_get((gint *) &sub->stats.conflated);
+        stats->blocked   = g_atomic_int_get((gint *) &sub->stats.blocked);
+    }
+    g_mutex_unlock(&ring->mtx);
+    return sub ? BL_NO_ERROR : ENOENT;
 }